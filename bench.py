@@ -0,0 +1,147 @@
+"""Benchmark driver for the lab binaries.
+
+Sweeps the blur, threshold, Jacobi (laplsolv) and particle binaries over
+worker counts and problem sizes, repeats every configuration and writes
+one row per configuration (median/min/mean/stddev of the reported times)
+as CSV or JSON for plot.py.
+
+Build the binaries first (make in lab1, lab2 and lab3), then e.g.
+
+    python3 bench.py --threads 1,2,4,8 --radii 5,30 -o results.csv
+    python3 plot.py results.csv
+"""
+
+import argparse
+import csv
+import json
+import os
+import re
+import statistics
+import subprocess
+import sys
+import tempfile
+
+
+# What each binary prints for the timed section
+FILTER_TIME = re.compile(r'Filtering took: ([0-9.eE+-]+)')
+MPI_TIME = re.compile(r'(?:MPI|hybrid) code took ([0-9.eE+-]+)')
+LAPL_TIME = re.compile(r'^Time: ([0-9.eE+-]+)', re.M)
+PART_TIME = re.compile(r'Time taken: ([0-9.eE+-]+)')
+
+
+def ints(text):
+    return [int(v) for v in text.split(',') if v]
+
+
+def mpirun(args, procs):
+    return args.mpirun.split() + ['-np', str(procs)]
+
+
+def make_image(directory, size):
+    """A size x size PPM of random pixels."""
+    path = os.path.join(directory, 'rand%d.ppm' % size)
+    if not os.path.exists(path):
+        with open(path, 'wb') as f:
+            f.write(b'P6\n%d %d 255\n' % (size, size))
+            f.write(os.urandom(3 * size * size))
+    return path
+
+
+def runs(args, images):
+    """Yields (benchmark, impl, workers, param, input, command, env, pattern)."""
+    lab1 = os.path.join(args.root, 'lab1')
+    out = os.path.join(args.tmpdir, 'out.ppm')
+    for image in images:
+        name = os.path.basename(image)
+        for workers in args.threads:
+            for radius in args.radii:
+                yield ('blur', 'pthreads', workers, radius, name,
+                       [os.path.join(lab1, 'blurc_pthreads'), str(radius), str(workers), image, out], None, FILTER_TIME)
+                yield ('blur', 'mpi', workers, radius, name,
+                       mpirun(args, workers) + [os.path.join(lab1, 'blurc_mpi'), str(radius), image, out], None, MPI_TIME)
+            yield ('threshold', 'pthreads', workers, '', name,
+                   [os.path.join(lab1, 'thresc_pthreads'), str(workers), image, out], None, FILTER_TIME)
+            yield ('threshold', 'mpi', workers, '', name,
+                   mpirun(args, workers) + [os.path.join(lab1, 'thresc_mpi'), image, out], None, MPI_TIME)
+
+    for workers in args.threads:
+        for size in args.lapl_sizes:
+            env = dict(os.environ, OMP_NUM_THREADS=str(workers))
+            yield ('jacobi', 'openmp', workers, size, '',
+                   [os.path.join(args.root, 'lab2', 'laplsolv'), str(size), str(args.lapl_iter), '0.001'], env, LAPL_TIME)
+        for steps in args.part_steps:
+            yield ('particles', 'mpi', workers, steps, '',
+                   mpirun(args, workers) + [os.path.join(args.root, 'lab3', 'part'), str(steps)], None, PART_TIME)
+
+
+def measure(command, env, pattern, repeat):
+    """Times of repeat runs; a run printing several (one per process) counts its slowest."""
+    times = []
+    for _ in range(repeat):
+        res = subprocess.run(command, env=env, stdout=subprocess.PIPE, stderr=subprocess.STDOUT,
+                             universal_newlines=True)
+        found = [float(t) for t in pattern.findall(res.stdout)]
+        if res.returncode != 0 or not found:
+            raise RuntimeError('%s failed:\n%s' % (' '.join(command), res.stdout[-2000:]))
+        times.append(max(found))
+    return times
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('--threads', type=ints, default=[1, 2, 4], help='thread/process counts, e.g. 1,2,4,8')
+    parser.add_argument('--radii', type=ints, default=[5], help='blur radii')
+    parser.add_argument('--root', default=os.path.dirname(os.path.abspath(__file__)),
+                        help='tree holding the built lab1, lab2 and lab3')
+    parser.add_argument('--images', default='', help='comma separated input images (default lab1/data/im1.ppm)')
+    parser.add_argument('--image-sizes', type=ints, default=[],
+                        help='also run on random square images of these sizes')
+    parser.add_argument('--lapl-sizes', type=ints, default=[1000], help='laplsolv grid sizes')
+    parser.add_argument('--lapl-iter', type=int, default=1000, help='laplsolv max iterations')
+    parser.add_argument('--part-steps', type=ints, default=[100], help='particle simulation time steps')
+    parser.add_argument('--only', default='', help='comma separated benchmarks to run '
+                        '(blur, threshold, jacobi, particles)')
+    parser.add_argument('--repeat', type=int, default=5, help='runs per configuration')
+    parser.add_argument('--mpirun', default='mpirun', help='MPI launcher and its options')
+    parser.add_argument('-o', '--output', default='-', help='output file, .json for JSON, else CSV')
+    args = parser.parse_args()
+
+    only = set(args.only.split(',')) - {''}
+    with tempfile.TemporaryDirectory() as tmpdir:
+        args.tmpdir = tmpdir
+        images = [i for i in args.images.split(',') if i] or [os.path.join(args.root, 'lab1', 'data', 'im1.ppm')]
+        images += [make_image(tmpdir, size) for size in args.image_sizes]
+
+        results = []
+        for bench, impl, workers, param, name, command, env, pattern in runs(args, images):
+            if only and bench not in only:
+                continue
+            binary = next(c for c in command if os.sep in c)
+            if not os.access(binary, os.X_OK):
+                print('skipping %s: %s is not built' % (bench, binary), file=sys.stderr)
+                continue
+            times = measure(command, env, pattern, args.repeat)
+            row = {
+                'benchmark': bench, 'impl': impl, 'workers': workers, 'param': param, 'input': name,
+                'runs': len(times), 'median': statistics.median(times), 'min': min(times),
+                'mean': statistics.mean(times), 'stddev': statistics.stdev(times) if len(times) > 1 else 0.0,
+            }
+            print('%(benchmark)s %(impl)s workers=%(workers)s param=%(param)s %(input)s: '
+                  'median %(median)g min %(min)g stddev %(stddev)g' % row, file=sys.stderr)
+            results.append(row)
+
+    out = sys.stdout if args.output == '-' else open(args.output, 'w', newline='')
+    if args.output.endswith('.json'):
+        json.dump(results, out, indent=1)
+        out.write('\n')
+    else:
+        fields = ['benchmark', 'impl', 'workers', 'param', 'input', 'runs', 'median', 'min', 'mean', 'stddev']
+        writer = csv.DictWriter(out, fieldnames=fields)
+        writer.writeheader()
+        writer.writerows(results)
+    if out is not sys.stdout:
+        out.close()
+
+
+if __name__ == '__main__':
+    main()
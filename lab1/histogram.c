@@ -0,0 +1,241 @@
+/*
+  File: histogram.c
+
+  Implementation of the histogram based threshold engine. One pass over the
+  image builds a histogram of r+g+b, the threshold is picked from the
+  histogram and a lookup table binarises the pixels.
+
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "histogram.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86 1
+#endif
+
+/* Pixels whose r+g+b thres_pack sums at a time */
+#define PACK_CHUNK 256
+
+int parse_thres_policy(const char *str, enum thres_policy *policy, double *param) {
+  char *end;
+
+  *param = 0;
+  if (strcmp(str, "mean") == 0)
+    *policy = THRES_MEAN;
+  else if (strcmp(str, "otsu") == 0)
+    *policy = THRES_OTSU;
+  else if (strncmp(str, "percentile:", 11) == 0) {
+    *policy = THRES_PERCENTILE;
+    *param = strtod(str + 11, &end);
+    if (*end != '\0' || *param < 0 || *param > 100)
+      return 1;
+  } else
+    return 1;
+  return 0;
+}
+
+void hist_add(uint64_t *hist, const unsigned char *rgb, long count) {
+  long i;
+
+  for (i = 0; i < count; i++, rgb += 3)
+    hist[rgb[0] + rgb[1] + rgb[2]]++;
+}
+
+void hist_add_gray(uint64_t *hist, const unsigned char *gray, long count) {
+  long i;
+
+  for (i = 0; i < count; i++)
+    hist[3 * gray[i]]++;
+}
+
+void hist_merge(uint64_t *hist, const uint64_t *other) {
+  int i;
+
+  for (i = 0; i < HIST_BINS; i++)
+    hist[i] += other[i];
+}
+
+/* Integer mean, so the result matches summing all pixels and dividing */
+static int mean_threshold(const uint64_t *hist, uint64_t n) {
+  uint64_t sum = 0;
+  int i;
+
+  for (i = 0; i < HIST_BINS; i++)
+    sum += hist[i] * i;
+  return sum / n;
+}
+
+static int otsu_threshold(const uint64_t *hist, uint64_t n) {
+  double total = 0, sum0 = 0, best = -1;
+  uint64_t n0 = 0;
+  int i, t = 0;
+
+  for (i = 0; i < HIST_BINS; i++)
+    total += (double)hist[i] * i;
+
+  /* Class 0 is [0, i), class 1 is [i, HIST_BINS) */
+  for (i = 1; i < HIST_BINS; i++) {
+    n0 += hist[i - 1];
+    sum0 += (double)hist[i - 1] * (i - 1);
+    if (n0 == 0 || n0 == n)
+      continue;
+    double mu0 = sum0 / n0, mu1 = (total - sum0) / (n - n0);
+    double between = (double)n0 * (n - n0) * (mu0 - mu1) * (mu0 - mu1);
+    if (between > best) {
+      best = between;
+      t = i;
+    }
+  }
+  return t;
+}
+
+static int percentile_threshold(const uint64_t *hist, uint64_t n, double percent) {
+  double below = 0, target = n * percent / 100;
+  int t;
+
+  for (t = 0; t < HIST_BINS && below < target; t++)
+    below += hist[t];
+  return t;
+}
+
+int hist_threshold(const uint64_t *hist, enum thres_policy policy, double param) {
+  uint64_t n = 0;
+  int i;
+
+  for (i = 0; i < HIST_BINS; i++)
+    n += hist[i];
+  if (n == 0)
+    return 0;
+
+  switch (policy) {
+  case THRES_OTSU:
+    return otsu_threshold(hist, n);
+  case THRES_PERCENTILE:
+    return percentile_threshold(hist, n, param);
+  default:
+    return mean_threshold(hist, n);
+  }
+}
+
+void thres_lut(int t, unsigned char *lut) {
+  int i;
+
+  for (i = 0; i < HIST_BINS; i++)
+    lut[i] = i < t ? 0 : 255;
+}
+
+void thres_apply(unsigned char *rgb, long count, const unsigned char *lut) {
+  long i;
+
+  for (i = 0; i < count; i++, rgb += 3)
+    rgb[0] = rgb[1] = rgb[2] = lut[rgb[0] + rgb[1] + rgb[2]];
+}
+
+void thres_apply_gray(unsigned char *gray, long count, const unsigned char *lut) {
+  long i;
+
+  for (i = 0; i < count; i++)
+    gray[i] = lut[3 * gray[i]];
+}
+
+/* bits[k] gets v[8k] < limit in bit 7 down to v[8k + 7] < limit in bit 0. */
+static void pack_below_u16(const uint16_t *v, int n, int limit, unsigned char *bits) {
+  int i, k;
+
+  for (i = 0; i < n; i += 8) {
+    unsigned char b = 0;
+    for (k = 0; k < 8; k++)
+      b |= (i + k < n && v[i + k] < limit) << (7 - k);
+    bits[i / 8] = b;
+  }
+}
+
+static void pack_below_u8(const unsigned char *v, int n, int limit, unsigned char *bits) {
+  int i, k;
+
+  for (i = 0; i < n; i += 8) {
+    unsigned char b = 0;
+    for (k = 0; k < 8; k++)
+      b |= (i + k < n && v[i + k] < limit) << (7 - k);
+    bits[i / 8] = b;
+  }
+}
+
+#ifdef HAVE_X86
+/* Reverses the bytes of every 8-byte group, so that movemask puts the
+   first pixel of a group in the most significant bit of its byte */
+#define PBM_ORDER(v) _mm256_shuffle_epi8((v), _mm256_setr_epi8( \
+    7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8, \
+    7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8))
+
+/* 32 pixels per step: compare, narrow to bytes, reorder, movemask */
+__attribute__((target("avx2")))
+static void pack_below_u16_avx2(const uint16_t *v, int n, int limit, unsigned char *bits) {
+  __m256i lim = _mm256_set1_epi16(limit);
+  uint32_t m;
+  int i;
+
+  for (i = 0; i + 32 <= n; i += 32) {
+    __m256i a = _mm256_cmpgt_epi16(lim, _mm256_loadu_si256((const __m256i *)(v + i)));
+    __m256i b = _mm256_cmpgt_epi16(lim, _mm256_loadu_si256((const __m256i *)(v + i + 16)));
+    /* packs works per 128-bit lane, the permute restores pixel order */
+    __m256i below = _mm256_permute4x64_epi64(_mm256_packs_epi16(a, b), 0xd8);
+    m = _mm256_movemask_epi8(PBM_ORDER(below));
+    memcpy(bits + i / 8, &m, 4);
+  }
+  pack_below_u16(v + i, n - i, limit, bits + i / 8);
+}
+
+__attribute__((target("avx2")))
+static void pack_below_u8_avx2(const unsigned char *v, int n, int limit, unsigned char *bits) {
+  __m256i lim = _mm256_set1_epi8((char)limit);
+  uint32_t m;
+  int i;
+
+  for (i = 0; i + 32 <= n; i += 32) {
+    __m256i x = _mm256_loadu_si256((const __m256i *)(v + i));
+    /* unsigned x >= limit exactly where max(x, limit) == x */
+    __m256i white = _mm256_cmpeq_epi8(_mm256_max_epu8(x, lim), x);
+    m = ~(uint32_t)_mm256_movemask_epi8(PBM_ORDER(white));
+    memcpy(bits + i / 8, &m, 4);
+  }
+  pack_below_u8(v + i, n - i, limit, bits + i / 8);
+}
+
+static int have_avx2(void) {
+  return __builtin_cpu_supports("avx2");
+}
+#endif
+
+void thres_pack(const unsigned char *rgb, int xsize, int t, unsigned char *bits) {
+  uint16_t sum[PACK_CHUNK];
+  int x, i, n;
+
+  for (x = 0; x < xsize; x += PACK_CHUNK) {
+    n = xsize - x < PACK_CHUNK ? xsize - x : PACK_CHUNK;
+    for (i = 0; i < n; i++, rgb += 3)
+      sum[i] = rgb[0] + rgb[1] + rgb[2];
+#ifdef HAVE_X86
+    if (have_avx2()) {
+      pack_below_u16_avx2(sum, n, t, bits + x / 8);
+      continue;
+    }
+#endif
+    pack_below_u16(sum, n, t, bits + x / 8);
+  }
+}
+
+void thres_pack_gray(const unsigned char *gray, int xsize, int t, unsigned char *bits) {
+  /* 3g < t exactly when g < ceil(t / 3) */
+  int limit = (t + 2) / 3;
+
+#ifdef HAVE_X86
+  if (have_avx2() && limit <= 255) {
+    pack_below_u8_avx2(gray, xsize, limit, bits);
+    return;
+  }
+#endif
+  pack_below_u8(gray, xsize, limit, bits);
+}
@@ -0,0 +1,60 @@
+/*
+  File: histogram.h
+
+  Declarations for the histogram based threshold engine.
+
+ */
+
+#ifndef _HISTOGRAM_H_
+#define _HISTOGRAM_H_
+
+#include <stdint.h>
+
+/* r+g+b of a pixel ranges over 0..765 */
+#define HIST_BINS 766
+
+/* Bytes of one bit-packed PBM (P4) row of xsize pixels */
+#define PBM_ROW_BYTES(xsize) (((xsize) + 7) / 8)
+
+/* How the threshold is chosen from the histogram */
+enum thres_policy {
+  THRES_MEAN,        /* mean intensity, as the original filter */
+  THRES_OTSU,        /* maximal between-class variance */
+  THRES_PERCENTILE   /* param percent of the pixels fall below */
+};
+
+/* Parse "mean", "otsu" or "percentile:P" into policy and param. */
+/* Returns: 0 on success.                                      */
+int parse_thres_policy(const char *str, enum thres_policy *policy, double *param);
+
+/* Add count pixels of packed r,g,b bytes to hist[HIST_BINS]. */
+void hist_add(uint64_t *hist, const unsigned char *rgb, long count);
+
+/* Add count gray bytes to hist[HIST_BINS], each as the pixel r = g = b = */
+/* gray, so thresholds come out the same as for the RGB expansion.       */
+void hist_add_gray(uint64_t *hist, const unsigned char *gray, long count);
+
+/* hist[i] += other[i] for all bins. */
+void hist_merge(uint64_t *hist, const uint64_t *other);
+
+/* Choose the threshold t from hist: pixels with r+g+b >= t become white. */
+int hist_threshold(const uint64_t *hist, enum thres_policy policy, double param);
+
+/* Fill lut[HIST_BINS] with 0 below t and 255 from t on. */
+void thres_lut(int t, unsigned char *lut);
+
+/* Binarise count pixels of packed r,g,b bytes through lut. */
+void thres_apply(unsigned char *rgb, long count, const unsigned char *lut);
+
+/* Binarise count gray bytes through lut, as hist_add_gray counts them. */
+void thres_apply_gray(unsigned char *gray, long count, const unsigned char *lut);
+
+/* Binarise one row of xsize pixels with threshold t straight into a PBM  */
+/* (P4) row of PBM_ROW_BYTES(xsize) bytes: most significant bit first, a  */
+/* set bit (black) where r+g+b < t, the padding bits of the last byte 0.  */
+void thres_pack(const unsigned char *rgb, int xsize, int t, unsigned char *bits);
+
+/* As thres_pack for a row of gray bytes, gray g standing for r+g+b = 3g. */
+void thres_pack_gray(const unsigned char *gray, int xsize, int t, unsigned char *bits);
+
+#endif
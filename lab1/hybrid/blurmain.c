@@ -0,0 +1,133 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <mpi.h>
+#include "../mpi/ppmio_mpi.h"
+#include "../mpi/halo.h"
+#include "../pthreads/blurfilter.h"
+#include "../gaussw.h"
+#include "../imgbuf.h"
+#include "../phases.h"
+
+#define MAX_RAD 1000
+
+int main(int argc, char **argv)
+{
+	int me, p, provided;
+	// Only the main thread of a process calls MPI, the workers never do
+	MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+	MPI_Comm_rank(MPI_COMM_WORLD, &me);
+	MPI_Comm_size(MPI_COMM_WORLD, &p);
+	phases_init(argv[0], me);
+
+	int radius, xsize, ysize, colmax;
+	MPI_Offset offset;
+	double w[MAX_RAD + 1];
+
+	if (provided < MPI_THREAD_FUNNELED)
+	{
+		if (me == 0)
+			fprintf(stderr, "MPI library does not support MPI_THREAD_FUNNELED\n");
+		MPI_Abort(MPI_COMM_WORLD, 1);
+	}
+
+	/* Take care of the arguments */
+	if (argc != 5)
+	{
+		if (me == 0)
+			fprintf(stderr, "Usage: %s radius threads infile outfile\n", argv[0]);
+		MPI_Finalize();
+		exit(1);
+	}
+
+	radius = atoi(argv[1]);
+	if ((radius > MAX_RAD) || (radius < 1))
+	{
+		if (me == 0)
+			fprintf(stderr, "Radius (%d) must be greater than zero and less then %d\n", radius, MAX_RAD);
+		MPI_Finalize();
+		exit(1);
+	}
+
+	int threads = atoi(argv[2]);
+	if (threads < 1)
+	{
+		if (me == 0)
+			fprintf(stderr, "Threads (%d) must be greater than zero\n", threads);
+		MPI_Finalize();
+		exit(1);
+	}
+
+	double read_time = MPI_Wtime();
+
+	/* Read header on P0, broadcast to all processes */
+	phase_begin(PHASE_READ);
+	if (read_ppm_header_mpi(argv[3], MPI_COMM_WORLD, &xsize, &ysize, &colmax, &offset) != 0)
+		MPI_Abort(MPI_COMM_WORLD, 1);
+
+	if (colmax > 255)
+	{
+		if (me == 0)
+			fprintf(stderr, "Too large maximum color-component value\n");
+		MPI_Abort(MPI_COMM_WORLD, 1);
+	}
+
+	// Every process owns a block of whole rows, its workers share it
+	int y0, y1, h0, h1;
+	row_block(me, p, ysize, &y0, &y1);
+	halo_range(y0, y1, ysize, radius, &h0, &h1);
+
+	/* Every process reads its own rows */
+	pixel *buf = imgbuf_get(sizeof(pixel) * (y1 - y0) * xsize);
+	if (read_ppm_rows_mpi(argv[3], MPI_COMM_WORLD, offset, xsize, y0, y1 - y0, (char *)buf) != 0)
+		MPI_Abort(MPI_COMM_WORLD, 1);
+	phase_end();
+
+	if (me == 0)
+		printf("Has read the image in %f, generating coefficients\n", MPI_Wtime() - read_time);
+
+	/* filter */
+	phase_begin(PHASE_WEIGHTS);
+	get_gauss_weights(radius, w);
+	phase_end();
+	filter_pool *pool = pool_create(threads, 1);
+
+	double start_time = MPI_Wtime();
+
+	// Row averages of the own block go between the halos
+	pixel *hbuf = imgbuf_get(sizeof(pixel) * (h1 - h0) * xsize);
+	blurfilter_rows(pool, xsize, y1 - y0, buf, hbuf + (y0 - h0) * xsize, radius, w);
+
+	/* Halo exchange, from the main thread */
+	MPI_Datatype row_type;
+	MPI_Type_contiguous(3 * xsize, MPI_UNSIGNED_CHAR, &row_type);
+	MPI_Type_commit(&row_type);
+
+	MPI_Request *reqs = malloc(sizeof(MPI_Request) * 2 * p);
+	phase_begin(PHASE_COMM);
+	int nreqs = post_halos(hbuf, xsize, ysize, radius, row_type, reqs);
+	MPI_Waitall(nreqs, reqs, MPI_STATUSES_IGNORE);
+	phase_end();
+
+	// Column averages of the own block, back into buf
+	blurfilter_cols(pool, xsize, h1 - h0, hbuf, y0 - h0, y1 - h0, buf, radius, w);
+
+	double end_time = MPI_Wtime();
+	printf("Process %d (%d threads) hybrid code took %f\n", me, threads, end_time - start_time);
+
+	/* Write result, every process its own rows */
+	if (me == 0)
+		printf("Writing output file\n");
+
+	phase_begin(PHASE_WRITE);
+	if (write_ppm_rows_mpi(argv[4], MPI_COMM_WORLD, xsize, ysize, y0, y1 - y0, (char *)buf) != 0)
+		MPI_Abort(MPI_COMM_WORLD, 1);
+	phase_end();
+
+	MPI_Type_free(&row_type);
+	pool_destroy(pool);
+	free(reqs);
+	imgbuf_put(hbuf);
+	imgbuf_put(buf);
+
+	MPI_Finalize();
+}
@@ -0,0 +1,105 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <mpi.h>
+#include "../mpi/ppmio_mpi.h"
+#include "../mpi/halo.h"
+#include "../pthreads/thresfilter.h"
+#include "../imgbuf.h"
+#include "../phases.h"
+
+int main(int argc, char **argv)
+{
+	int me, p, provided;
+	// Only the main thread of a process calls MPI, the workers never do
+	MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+	MPI_Comm_rank(MPI_COMM_WORLD, &me);
+	MPI_Comm_size(MPI_COMM_WORLD, &p);
+	phases_init(argv[0], me);
+
+	int xsize, ysize, colmax;
+	MPI_Offset offset;
+	enum thres_policy policy = THRES_MEAN;
+	double param = 0;
+
+	if (provided < MPI_THREAD_FUNNELED)
+	{
+		if (me == 0)
+			fprintf(stderr, "MPI library does not support MPI_THREAD_FUNNELED\n");
+		MPI_Abort(MPI_COMM_WORLD, 1);
+	}
+
+	/* Take care of the arguments */
+	int opt;
+	while ((opt = getopt(argc, argv, "p:")) != -1)
+	{
+		if (opt != 'p' || parse_thres_policy(optarg, &policy, &param) != 0)
+			argc = 0;
+	}
+	// Drop the options, keeping the program name in argv[0]
+	argv[optind - 1] = argv[0];
+	argc -= optind - 1;
+	argv += optind - 1;
+
+	int threads = argc == 4 ? atoi(argv[1]) : 0;
+	if (threads < 1)
+	{
+		if (me == 0)
+			fprintf(stderr, "Usage: %s [-p mean|otsu|percentile:P] threads infile outfile\n", argv[0]);
+		MPI_Finalize();
+		exit(1);
+	}
+
+	/* Read header on P0, broadcast to all processes */
+	phase_begin(PHASE_READ);
+	if (read_ppm_header_mpi(argv[2], MPI_COMM_WORLD, &xsize, &ysize, &colmax, &offset) != 0)
+		MPI_Abort(MPI_COMM_WORLD, 1);
+
+	if (colmax > 255)
+	{
+		if (me == 0)
+			fprintf(stderr, "Too large maximum color-component value\n");
+		MPI_Abort(MPI_COMM_WORLD, 1);
+	}
+
+	// Every process owns a block of whole rows, its workers share it
+	int y0, y1;
+	row_block(me, p, ysize, &y0, &y1);
+
+	/* Every process reads its own part of the image */
+	pixel *buf = imgbuf_get(sizeof(pixel) * (y1 - y0) * xsize);
+	if (read_ppm_rows_mpi(argv[2], MPI_COMM_WORLD, offset, xsize, y0, y1 - y0, (char *)buf) != 0)
+		MPI_Abort(MPI_COMM_WORLD, 1);
+	phase_end();
+
+	filter_pool *pool = pool_create(threads, 1);
+	double start_time = MPI_Wtime();
+
+	// Histogram of the block on the workers, summed over all processes
+	uint64_t hist[HIST_BINS];
+	thresfilter_histogram(pool, xsize, y1 - y0, buf, hist);
+	phase_begin(PHASE_COMM);
+	MPI_Allreduce(MPI_IN_PLACE, hist, HIST_BINS, MPI_UINT64_T, MPI_SUM, MPI_COMM_WORLD);
+	phase_end();
+
+	// Every process picks the same threshold from the global histogram
+	int t = thresfilter_apply(pool, xsize, y1 - y0, buf, hist, policy, param);
+
+	if (me == 0)
+	{
+		printf("Process %d (%d threads) hybrid code took %f\n", me, threads, MPI_Wtime() - start_time);
+		printf("Threshold: %d\n", t);
+		printf("Writing output file\n");
+	}
+
+	/* Every process writes its own part of the image */
+	phase_begin(PHASE_WRITE);
+	if (write_ppm_rows_mpi(argv[3], MPI_COMM_WORLD, xsize, ysize, y0, y1 - y0, (char *)buf) != 0)
+		MPI_Abort(MPI_COMM_WORLD, 1);
+	phase_end();
+
+	pool_destroy(pool);
+	imgbuf_put(buf);
+
+	MPI_Finalize();
+}
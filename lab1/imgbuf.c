@@ -0,0 +1,98 @@
+/*
+  File: imgbuf.c
+
+  Implementation of the image buffer pool. Every buffer handed out is
+  recorded with its capacity; a request takes the smallest idle buffer
+  that fits, or allocates a new one in place of the largest idle buffer
+  that does not, so the pool follows the image size without growing.
+
+ */
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include "imgbuf.h"
+
+/* Transparent huge page size on x86-64 and most arm64 kernels */
+#define HUGE_PAGE (2UL << 20)
+
+/* Buffers tracked at once; beyond that they are plainly freed */
+#define MAX_BUFS 32
+
+typedef struct {
+  void *ptr;
+  size_t cap;
+  int busy;
+} imgbuf;
+
+static imgbuf bufs[MAX_BUFS];
+static int num_bufs;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void *new_buffer(size_t len, size_t *cap) {
+  void *ptr;
+  size_t align = len >= HUGE_PAGE ? HUGE_PAGE : IMGBUF_ALIGN;
+
+  *cap = (len + align - 1) / align * align;
+  if (*cap == 0)
+    *cap = align;
+  if (posix_memalign(&ptr, align, *cap) != 0)
+    return NULL;
+
+  /* Only advice: without THP support the buffer is used as it is */
+  if (align == HUGE_PAGE && getenv("IMGBUF_NO_HUGEPAGE") == NULL)
+    madvise(ptr, *cap, MADV_HUGEPAGE);
+  return ptr;
+}
+
+void *imgbuf_get(size_t len) {
+  int i, fit = -1, spare = -1;
+  size_t cap;
+  void *ptr;
+
+  pthread_mutex_lock(&lock);
+  for (i = 0; i < num_bufs; i++) {
+    if (bufs[i].busy)
+      continue;
+    if (bufs[i].cap >= len && (fit < 0 || bufs[i].cap < bufs[fit].cap))
+      fit = i;
+    if (bufs[i].cap < len && (spare < 0 || bufs[i].cap > bufs[spare].cap))
+      spare = i;
+  }
+  if (fit >= 0) {
+    bufs[fit].busy = 1;
+    pthread_mutex_unlock(&lock);
+    return bufs[fit].ptr;
+  }
+
+  /* Nothing fits: the largest idle buffer makes room for a new one */
+  if (spare >= 0) {
+    free(bufs[spare].ptr);
+    bufs[spare] = bufs[--num_bufs];
+  }
+  ptr = new_buffer(len, &cap);
+  if (ptr != NULL && num_bufs < MAX_BUFS) {
+    bufs[num_bufs].ptr = ptr;
+    bufs[num_bufs].cap = cap;
+    bufs[num_bufs].busy = 1;
+    num_bufs++;
+  }
+  pthread_mutex_unlock(&lock);
+  return ptr;
+}
+
+void imgbuf_put(void *buf) {
+  int i;
+
+  if (buf == NULL)
+    return;
+  pthread_mutex_lock(&lock);
+  for (i = 0; i < num_bufs; i++)
+    if (bufs[i].ptr == buf) {
+      bufs[i].busy = 0;
+      pthread_mutex_unlock(&lock);
+      return;
+    }
+  pthread_mutex_unlock(&lock);
+  free(buf);
+}
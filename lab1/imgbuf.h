@@ -0,0 +1,30 @@
+/*
+  File: imgbuf.h
+
+  Recycling allocator for image sized buffers. Buffers are 64-byte
+  aligned; large ones are aligned to and padded to whole huge pages and
+  advised for transparent huge pages, so a full image costs a few TLB
+  entries instead of thousands. A released buffer is kept and handed out
+  again for any request it is large enough for, so filtering many images
+  or passes faults the pages in only once.
+
+  IMGBUF_NO_HUGEPAGE in the environment turns the huge-page advice off.
+
+ */
+
+#ifndef _IMGBUF_H_
+#define _IMGBUF_H_
+
+#include <stddef.h>
+
+/* Alignment of every buffer */
+#define IMGBUF_ALIGN 64
+
+/* A buffer of at least len bytes, NULL when out of memory. The contents */
+/* are undefined: a recycled buffer keeps whatever it held before.       */
+void *imgbuf_get(size_t len);
+
+/* Hands a buffer from imgbuf_get back for reuse. NULL is ignored. */
+void imgbuf_put(void *buf);
+
+#endif
@@ -1,7 +1,6 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include "blurfilter.h"
-#include "../ppmio.h"
 
 pixel *pix(pixel *image, const int xx, const int yy, const int xsize)
 {
@@ -31,4 +30,36 @@ void compute_row(int y, int xsize, int radius, const double *weights, pixel* buf
 		pix(dst, x, y, xsize)->g = g / n;
 		pix(dst, x, y, xsize)->b = b / n;
 	}
-}
\ No newline at end of file
+}
+
+void compute_col_row(int y, int rows, int xsize, int radius, const double *weights, pixel *buf, pixel *dst, double *acc)
+{
+	double n = 0;
+	for (int i = 0; i < 3 * xsize; ++i)
+		acc[i] = 0;
+
+	// Accumulate whole rows so every tap is a contiguous read
+	for (int wi = -radius; wi <= radius; wi++)
+	{
+		double wc = weights[abs(wi)];
+		int y2 = y + wi;
+		if (y2 >= 0 && y2 < rows)
+		{
+			pixel *row = pix(buf, 0, y2, xsize);
+			for (int x = 0; x < xsize; ++x)
+			{
+				acc[3 * x] += wc * row[x].r;
+				acc[3 * x + 1] += wc * row[x].g;
+				acc[3 * x + 2] += wc * row[x].b;
+			}
+			n += wc;
+		}
+	}
+
+	for (int x = 0; x < xsize; ++x)
+	{
+		dst[x].r = acc[3 * x] / n;
+		dst[x].g = acc[3 * x + 1] / n;
+		dst[x].b = acc[3 * x + 2] / n;
+	}
+}
@@ -6,6 +6,8 @@
 #ifndef _BLURFILTER_H_
 #define _BLURFILTER_H_
 
+#include "halo.h"
+
 /* NOTE: This structure must not be padded! */
 typedef struct _pixel {
 	unsigned char r,g,b;
@@ -13,4 +15,8 @@ typedef struct _pixel {
 
 void compute_row(int y, int xsize, int radius, const double *weights, pixel* buf, pixel* dst);
 
-#endif
\ No newline at end of file
+/* Column-wise average for row y of buf (rows rows high) written to the row
+   dst. acc holds 3 * xsize doubles of scratch. */
+void compute_col_row(int y, int rows, int xsize, int radius, const double *weights, pixel *buf, pixel *dst, double *acc);
+
+#endif
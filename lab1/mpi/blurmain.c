@@ -2,29 +2,50 @@
 #include <stdio.h>
 #include <string.h>
 #include <time.h>
-#include "../ppmio.h"
+#include <unistd.h>
+#include "ppmio_mpi.h"
 #include "blurfilter.h"
 #include "../gaussw.h"
+#include "../imgbuf.h"
+#include "../phases.h"
 #include <math.h>
 #include <mpi.h>
 
 #define MAX_RAD 1000
 
+// Rows of the overlapped vertical pass between checks on the halo messages
+#define PROGRESS_ROWS 8
+
 int main(int argc, char **argv)
 {
 	int me, p;
 	MPI_Init(&argc, &argv);
 	MPI_Comm_rank(MPI_COMM_WORLD, &me);
 	MPI_Comm_size(MPI_COMM_WORLD, &p);
+	phases_init(argv[0], me);
 
 	int radius, xsize, ysize, colmax;
-	pixel *src = NULL;
-	double w[MAX_RAD];
+	MPI_Offset offset;
+	double w[MAX_RAD + 1];
+	int overlap = 0;
 
 	/* Take care of the arguments */
+	int opt;
+	while ((opt = getopt(argc, argv, "o")) != -1)
+	{
+		if (opt == 'o')
+			overlap = 1;
+		else
+			argc = 0;
+	}
+	// Drop the options, keeping the program name in argv[0]
+	argv[optind - 1] = argv[0];
+	argc -= optind - 1;
+	argv += optind - 1;
+
 	if (argc != 4)
 	{
-		fprintf(stderr, "Usage: %s radius infile outfile\n", argv[0]);
+		fprintf(stderr, "Usage: %s [-o] radius infile outfile\n", argv[0]);
 		exit(1);
 	}
 
@@ -35,119 +56,143 @@ int main(int argc, char **argv)
 		exit(1);
 	}
 
-	if(me == 0) { //P0 only section
-
-		src = (pixel *)malloc(sizeof(pixel) * MAX_PIXELS);
+	double read_time = MPI_Wtime();
 
-		/* Read file */
-		if (read_ppm(argv[2], &xsize, &ysize, &colmax, (char *)src) != 0)
-			exit(1);
+	/* Read header on P0, broadcast to all processes */
+	phase_begin(PHASE_READ);
+	if (read_ppm_header_mpi(argv[2], MPI_COMM_WORLD, &xsize, &ysize, &colmax, &offset) != 0)
+		MPI_Abort(MPI_COMM_WORLD, 1);
 
-		if (colmax > 255)
-		{
+	if (colmax > 255)
+	{
+		if (me == 0)
 			fprintf(stderr, "Too large maximum color-component value\n");
-			exit(1);
-		}
-
-		printf("Has read the image, generating coefficients\n");
+		MPI_Abort(MPI_COMM_WORLD, 1);
 	}
 
+	// Every process owns a block of whole rows for both passes
+	int y0, y1, h0, h1;
+	row_block(me, p, ysize, &y0, &y1);
+	halo_range(y0, y1, ysize, radius, &h0, &h1);
+
+	/* Every process reads its own rows */
+	pixel *buf = imgbuf_get(sizeof(pixel) * (y1 - y0) * xsize);
+	if (read_ppm_rows_mpi(argv[2], MPI_COMM_WORLD, offset, xsize, y0, y1 - y0, (char *)buf) != 0)
+		MPI_Abort(MPI_COMM_WORLD, 1);
+	phase_end();
+
+	if (me == 0)
+		printf("Has read the image in %f, generating coefficients\n", MPI_Wtime() - read_time);
+
 	/* filter */
+	phase_begin(PHASE_WEIGHTS);
 	get_gauss_weights(radius, w);
+	phase_end();
 
 	double start_time = MPI_Wtime();
 
-	//Broadcast ysize and xsize to all processes
-	MPI_Bcast(&ysize, 1, MPI_INT, 0, MPI_COMM_WORLD);
-	MPI_Bcast(&xsize, 1, MPI_INT, 0, MPI_COMM_WORLD);
-
 	/* Row-wise Section */
 
-	int *sendcounts = (int *)malloc(p * sizeof(int));
-	int *displs = (int *)malloc(p * sizeof(int));
-
-	// Compute the send counts and their offsets
-	int rowsPerThread = ysize / p;
-
-	for (int i = 0; i < p; ++i)
-	{
-		displs[i] = 3 * i * rowsPerThread * xsize;
-		if (i == p - 1)
-			rowsPerThread += ysize % p;
-		sendcounts[i] = rowsPerThread * xsize * 3;
-	}
-
-	pixel *buf = malloc(sizeof(unsigned char) * sendcounts[me]);
-	MPI_Scatterv(src, sendcounts, displs, MPI_UNSIGNED_CHAR, buf, sendcounts[me], MPI_UNSIGNED_CHAR, 0, MPI_COMM_WORLD);
-
-	pixel* dst = malloc(sizeof(unsigned char) * sendcounts[me]);
-	
-	int endRow = sendcounts[me] / (3*xsize);
-
-	// Compute the weighted row-wise averages for pixels of the assigned rows
-	for (int y = 0; y < endRow; ++y)
-		compute_row(y, xsize, radius, w, buf, dst);
+	// Row averages of the own block go between the halos
+	pixel *hbuf = imgbuf_get(sizeof(pixel) * (h1 - h0) * xsize);
+	pixel *own = hbuf + (y0 - h0) * xsize;
+	int rows = y1 - y0;
 
-	// Gather the results and scatter column-wise
-	MPI_Gatherv(dst, sendcounts[me], MPI_UNSIGNED_CHAR, src, sendcounts, displs, MPI_UNSIGNED_CHAR, 0, MPI_COMM_WORLD);
+	// Only the radius rows next to the block travel, straight between the
+	// processes that need them
+	MPI_Datatype row_type;
+	MPI_Type_contiguous(3 * xsize, MPI_UNSIGNED_CHAR, &row_type);
+	MPI_Type_commit(&row_type);
 
-	/* Column-wise Section */
+	MPI_Request *reqs = malloc(sizeof(MPI_Request) * 2 * p);
+	double *acc = malloc(sizeof(double) * 3 * xsize);
 
-	//Custom data type creation for columns
-	MPI_Datatype col, col_type;
-
-	if (me == 0) {
-		MPI_Type_vector(ysize,    
-				3,                  
-				xsize*3,
-				MPI_UNSIGNED_CHAR,       
-				&col);     
-
-		MPI_Type_commit(&col);
-		MPI_Type_create_resized(col, 0, 3*sizeof(unsigned char), &col_type);
-		MPI_Type_commit(&col_type);
-	}
-
-	int colsPerThread = xsize / p;
-
-	// Compute the send counts and their offsets
-	for (int i = 0; i < p; ++i)
+	if (!overlap)
 	{
-		displs[i] = i * colsPerThread;
-		if (i == p - 1)
-			colsPerThread += xsize % p;
-		sendcounts[i] = colsPerThread;
+		// Compute the weighted row-wise averages for pixels of the assigned rows
+		phase_begin(PHASE_HPASS);
+		for (int y = 0; y < rows; ++y)
+			compute_row(y, xsize, radius, w, buf, own);
+		phase_end();
+
+		/* Halo exchange */
+		phase_begin(PHASE_COMM);
+		int nreqs = post_halos(hbuf, xsize, ysize, radius, row_type, reqs);
+		MPI_Waitall(nreqs, reqs, MPI_STATUSES_IGNORE);
+		phase_end();
+
+		/* Column-wise Section */
+
+		// Compute the weighted column-wise averages for pixels of the assigned rows
+		phase_begin(PHASE_VPASS);
+		for (int y = y0; y < y1; ++y)
+			compute_col_row(y - h0, h1 - h0, xsize, radius, w, hbuf, buf + (y - y0) * xsize, acc);
+		phase_end();
 	}
+	else
+	{
+		// The radius rows at either edge of the block are all the other
+		// processes need, so they are averaged first and sent while the
+		// rest of the block is computed
+		int edge = radius < rows ? radius : rows;
+		phase_begin(PHASE_HPASS);
+		for (int y = 0; y < edge; ++y)
+			compute_row(y, xsize, radius, w, buf, own);
+		for (int y = rows - edge > edge ? rows - edge : edge; y < rows; ++y)
+			compute_row(y, xsize, radius, w, buf, own);
+
+		phase_begin(PHASE_COMM);
+		int nreqs = post_halos(hbuf, xsize, ysize, radius, row_type, reqs);
+		int arrived = 0;
+		phase_end();
+
+		for (int y = edge; y < rows - edge; ++y)
+			compute_row(y, xsize, radius, w, buf, own);
+		phase_end();
+
+		// Interior rows: their window holds no halo rows. Testing the
+		// requests now and then lets MPI move the messages along.
+		int i0 = h0 < y0 ? y0 + radius : y0;
+		int i1 = h1 > y1 ? y1 - radius : y1;
+		phase_begin(PHASE_VPASS);
+		for (int y = i0; y < i1; ++y)
+		{
+			compute_col_row(y - h0, h1 - h0, xsize, radius, w, hbuf, buf + (y - y0) * xsize, acc);
+			if (!arrived && (y - i0) % PROGRESS_ROWS == 0)
+			{
+				phase_begin(PHASE_COMM);
+				MPI_Testall(nreqs, reqs, &arrived, MPI_STATUSES_IGNORE);
+				phase_end();
+			}
+		}
 
-	int recvcount = sendcounts[me] * ysize * 3;
-
-	free(buf);
-	buf = malloc(sizeof(unsigned char) * recvcount);
-
-	MPI_Scatterv(src, sendcounts, displs, col_type, buf, recvcount, MPI_UNSIGNED_CHAR, 0, MPI_COMM_WORLD);
-
-	free(dst);
-	dst = malloc(sizeof(unsigned char) * recvcount);
-
-	int endColumn = sendcounts[me];
-
-	// Compute the weighted column-wise averages for pixels of the assigned columns (re-using the compute_row function)
-	for (int x = 0; x < endColumn; ++x)
-		compute_row(x, ysize, radius, w, buf, dst);
-
-	MPI_Gatherv(dst, recvcount, MPI_UNSIGNED_CHAR, src, sendcounts, displs, col_type, 0, MPI_COMM_WORLD);
+		/* Boundary rows, once the halos are in */
+		phase_begin(PHASE_COMM);
+		MPI_Waitall(nreqs, reqs, MPI_STATUSES_IGNORE);
+		phase_end();
+		for (int y = y0; y < y1; ++y)
+			if (y < i0 || y >= i1)
+				compute_col_row(y - h0, h1 - h0, xsize, radius, w, hbuf, buf + (y - y0) * xsize, acc);
+		phase_end();
+	}
 
 	double end_time = MPI_Wtime();
 	printf("Process %d MPI code took %f\n", me, end_time - start_time);
 
-	MPI_Finalize();
+	/* Write result, every process its own rows */
+	if (me == 0)
+		printf("Writing output file\n");
 
-	if(me == 0) {
+	phase_begin(PHASE_WRITE);
+	if (write_ppm_rows_mpi(argv[3], MPI_COMM_WORLD, xsize, ysize, y0, y1 - y0, (char *)buf) != 0)
+		MPI_Abort(MPI_COMM_WORLD, 1);
+	phase_end();
 
-		/* Write result */
-		printf("Writing output file\n");
+	MPI_Type_free(&row_type);
+	free(acc);
+	free(reqs);
+	imgbuf_put(hbuf);
+	imgbuf_put(buf);
 
-		if (write_ppm(argv[3], xsize, ysize, (char *)src) != 0)
-			exit(1);
-	}
+	MPI_Finalize();
 }
@@ -0,0 +1,56 @@
+/*
+  File: halo.c
+  Row-block distribution and halo exchange of the MPI and hybrid blur.
+ */
+
+#include <stddef.h>
+#include "halo.h"
+
+void row_block(int rank, int p, int ysize, int *y0, int *y1)
+{
+	int rows = ysize / p, rem = ysize % p;
+	// The first rem processes take one of the remaining rows each
+	*y0 = rank * rows + (rank < rem ? rank : rem);
+	*y1 = *y0 + rows + (rank < rem);
+}
+
+void halo_range(int y0, int y1, int ysize, int radius, int *h0, int *h1)
+{
+	*h0 = y0 - radius > 0 ? y0 - radius : 0;
+	*h1 = y1 + radius < ysize ? y1 + radius : ysize;
+}
+
+int post_halos(void *hbuf, int xsize, int ysize, int radius, MPI_Datatype row_type, MPI_Request *reqs)
+{
+	int me, p, count = 0;
+	MPI_Comm_rank(MPI_COMM_WORLD, &me);
+	MPI_Comm_size(MPI_COMM_WORLD, &p);
+
+	int y0, y1, h0, h1;
+	row_block(me, p, ysize, &y0, &y1);
+	halo_range(y0, y1, ysize, radius, &h0, &h1);
+
+	for (int q = 0; q < p; ++q)
+	{
+		if (q == me)
+			continue;
+
+		int q0, q1, qh0, qh1;
+		row_block(q, p, ysize, &q0, &q1);
+		halo_range(q0, q1, ysize, radius, &qh0, &qh1);
+
+		// Rows of q inside my halo. With a radius deeper than a block this
+		// reaches past the direct neighbours.
+		int lo = q0 > h0 ? q0 : h0;
+		int hi = q1 < h1 ? q1 : h1;
+		if (lo < hi)
+			MPI_Irecv((char *)hbuf + (size_t)(lo - h0) * 3 * xsize, hi - lo, row_type, q, 0, MPI_COMM_WORLD, &reqs[count++]);
+
+		// Rows of mine inside the halo of q
+		lo = y0 > qh0 ? y0 : qh0;
+		hi = y1 < qh1 ? y1 : qh1;
+		if (lo < hi)
+			MPI_Isend((char *)hbuf + (size_t)(lo - h0) * 3 * xsize, hi - lo, row_type, q, 0, MPI_COMM_WORLD, &reqs[count++]);
+	}
+	return count;
+}
@@ -0,0 +1,25 @@
+/*
+  File: halo.h
+  Declaration of the row-block distribution and halo exchange shared by
+  the MPI and hybrid blur.
+ */
+
+#ifndef _HALO_H_
+#define _HALO_H_
+
+#include <mpi.h>
+
+/* Rows [y0, y1) of the ysize rows owned by rank out of p. */
+void row_block(int rank, int p, int ysize, int *y0, int *y1);
+
+/* Rows [h0, h1) the vertical pass over [y0, y1) reads: the block plus up
+   to radius rows of halo on either side. */
+void halo_range(int y0, int y1, int ysize, int radius, int *h0, int *h1);
+
+/* Posts the non-blocking exchange of radius-deep halos with every rank
+   whose block overlaps them. hbuf holds the rows [h0, h1) of this rank,
+   3 * xsize bytes each, with the own block already filled in. Returns the
+   number of requests written to reqs (at most 2 * (p - 1)). */
+int post_halos(void *hbuf, int xsize, int ysize, int radius, MPI_Datatype row_type, MPI_Request *reqs);
+
+#endif
@@ -0,0 +1,128 @@
+/*
+  File: ppmio_mpi.c
+
+  Implementation of the collective PPM image file IO functions.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include "ppmio_mpi.h"
+#include "../ppmio.h"
+
+/* One row of data, so counts stay small for very large images */
+static MPI_Datatype row_type (int row_bytes) {
+  MPI_Datatype row;
+  MPI_Type_contiguous (row_bytes, MPI_UNSIGNED_CHAR, &row);
+  MPI_Type_commit (&row);
+  return row;
+}
+
+int read_ppm_header_mpi (const char * fname, MPI_Comm comm,
+			 int * xpix, int * ypix, int * max, MPI_Offset * offset) {
+  int me;
+  long long hdr[5] = { 0, 0, 0, 0, 0 };   /* status, x, y, max, offset */
+
+  MPI_Comm_rank (comm, &me);
+  if (me == 0) {
+    FILE * fp = fopen (fname, "r");
+    if (fp == NULL) {
+      fprintf (stderr, "read_ppm_header_mpi failed to open %s: %s\n", fname,
+	       strerror (errno));
+      hdr[0] = 1;
+    } else {
+      int x, y, m;
+      hdr[0] = read_ppm_header (fp, &x, &y, &m);
+      hdr[1] = x;
+      hdr[2] = y;
+      hdr[3] = m;
+      hdr[4] = ftell (fp);
+      fclose (fp);
+    }
+  }
+
+  MPI_Bcast (hdr, 5, MPI_LONG_LONG, 0, comm);
+  *xpix = hdr[1];
+  *ypix = hdr[2];
+  *max = hdr[3];
+  *offset = hdr[4];
+  return hdr[0];
+}
+
+int read_ppm_rows_mpi (const char * fname, MPI_Comm comm, MPI_Offset offset,
+		       int xpix, int y0, int rows, char * data) {
+  MPI_File fh;
+  MPI_Status status;
+  int got, ret = 0;
+
+  if (MPI_File_open (comm, fname, MPI_MODE_RDONLY, MPI_INFO_NULL, &fh)
+      != MPI_SUCCESS) {
+    fprintf (stderr, "read_ppm_rows_mpi failed to open %s\n", fname);
+    return 1;
+  }
+
+  MPI_Datatype row = row_type (3 * xpix);
+  if (MPI_File_read_at_all (fh, offset + (MPI_Offset)y0 * xpix * 3, data,
+			    rows, row, &status) != MPI_SUCCESS
+      || MPI_Get_count (&status, row, &got) != MPI_SUCCESS || got != rows) {
+    fprintf (stderr, "Read failed\n");
+    ret = 2;
+  }
+  MPI_Type_free (&row);
+
+  MPI_File_close (&fh);
+  MPI_Allreduce (MPI_IN_PLACE, &ret, 1, MPI_INT, MPI_MAX, comm);
+  return ret;
+}
+
+/* Process 0 writes header, every process its rows of row_bytes each */
+static int write_rows_mpi (const char * fname, MPI_Comm comm,
+			   const char * header, int row_bytes, int ypix,
+			   int y0, int rows, char * data) {
+  MPI_File fh;
+  int me, len = strlen (header), ret = 0;
+
+  MPI_Comm_rank (comm, &me);
+
+  if (MPI_File_open (comm, fname, MPI_MODE_WRONLY | MPI_MODE_CREATE,
+		     MPI_INFO_NULL, &fh) != MPI_SUCCESS) {
+    fprintf (stderr, "write_rows_mpi failed to open %s\n", fname);
+    return 1;
+  }
+  /* Drop whatever a previous, larger file left behind */
+  MPI_File_set_size (fh, len + (MPI_Offset)row_bytes * ypix);
+
+  if (me == 0 && MPI_File_write_at (fh, 0, header, len, MPI_CHAR,
+				    MPI_STATUS_IGNORE) != MPI_SUCCESS)
+    ret = 2;
+
+  MPI_Datatype row = row_type (row_bytes);
+  if (MPI_File_write_at_all (fh, len + (MPI_Offset)y0 * row_bytes, data,
+			     rows, row, MPI_STATUS_IGNORE) != MPI_SUCCESS)
+    ret = 2;
+  MPI_Type_free (&row);
+
+  if (MPI_File_close (&fh) != MPI_SUCCESS)
+    ret = 3;
+  MPI_Allreduce (MPI_IN_PLACE, &ret, 1, MPI_INT, MPI_MAX, comm);
+  if (ret != 0 && me == 0)
+    fprintf (stderr, "Write failed\n");
+  return ret;
+}
+
+int write_ppm_rows_mpi (const char * fname, MPI_Comm comm,
+			int xpix, int ypix, int y0, int rows, char * data) {
+  char header[64];
+
+  snprintf (header, sizeof (header), "P6\n%d %d 255\n", xpix, ypix);
+  return write_rows_mpi (fname, comm, header, 3 * xpix, ypix, y0, rows, data);
+}
+
+int write_pbm_rows_mpi (const char * fname, MPI_Comm comm,
+			int xpix, int ypix, int y0, int rows, char * bits) {
+  char header[64];
+
+  snprintf (header, sizeof (header), "P4\n%d %d\n", xpix, ypix);
+  return write_rows_mpi (fname, comm, header, (xpix + 7) / 8, ypix, y0, rows,
+			 bits);
+}
@@ -0,0 +1,49 @@
+/*
+  File: ppmio_mpi.h
+
+  Declarations for the collective (MPI-IO) PPM image file IO functions.
+  Every process reads and writes its own block of rows straight from and to
+  the file; only the header goes through process 0.
+*/
+#ifndef _PPMIO_MPI_H_
+#define _PPMIO_MPI_H_
+
+#include <mpi.h>
+
+/* Function: read_ppm_header_mpi - collective; process 0 parses the header
+   of a PPM (P6) file and broadcasts it.
+   Input: fname - name of an image file in PPM format.
+   Output:
+      xpix, ypix - size of the image in x & y directions
+      max - maximum intensity in the picture
+      offset - position of the color data in the file
+   Returns: 0 on success, the same value on every process.
+ */
+int read_ppm_header_mpi (const char * fname, MPI_Comm comm,
+			 int * xpix, int * ypix, int * max, MPI_Offset * offset);
+
+/* Function: read_ppm_rows_mpi - collective read of the rows [y0, y0+rows)
+   of every process.
+   Input: fname, xpix, offset - as returned by read_ppm_header_mpi.
+   Output: data - rows * xpix * 3 bytes of color data.
+   Returns: 0 on success.
+ */
+int read_ppm_rows_mpi (const char * fname, MPI_Comm comm, MPI_Offset offset,
+		       int xpix, int y0, int rows, char * data);
+
+/* Function: write_ppm_rows_mpi - collective write of a PPM file where
+   every process contributes the rows [y0, y0+rows).
+   Returns: 0 on success.
+ */
+int write_ppm_rows_mpi (const char * fname, MPI_Comm comm,
+			int xpix, int ypix, int y0, int rows, char * data);
+
+/* Function: write_pbm_rows_mpi - collective write of a bit-packed PBM (P4)
+   file where every process contributes the rows [y0, y0+rows), each of
+   (xpix+7)/8 bytes as write_pbm expects them.
+   Returns: 0 on success.
+ */
+int write_pbm_rows_mpi (const char * fname, MPI_Comm comm,
+			int xpix, int ypix, int y0, int rows, char * bits);
+
+#endif
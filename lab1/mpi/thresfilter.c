@@ -1,27 +1,47 @@
 #include "thresfilter.h"
+#include "../phases.h"
 #include <mpi.h>
 #include <stdio.h>
+#include <string.h>
 
-typedef unsigned int uint;
-
-void thresfilter(pixel *buf, int const count, int const N)
+// Threshold chosen from the histogram of the count pixels of buf summed
+// over all processes
+static int global_threshold(pixel *buf, int const count, enum thres_policy policy, double param)
 {
-	uint sum = 0;
-	// Compute average over all pixels
-	for (int i = 0; i < count; ++i)
-		sum += (uint)buf[i].r + (uint)buf[i].g + (uint)buf[i].b;
-	sum /= N;
+	uint64_t hist[HIST_BINS];
+	memset(hist, 0, sizeof(hist));
+	phase_begin(PHASE_HIST);
+	hist_add(hist, &buf->r, count);
+	phase_end();
+	phase_begin(PHASE_COMM);
+	MPI_Allreduce(MPI_IN_PLACE, hist, HIST_BINS, MPI_UINT64_T, MPI_SUM, MPI_COMM_WORLD);
+	phase_end();
+
+	// Every process picks the same threshold from the global histogram
+	return hist_threshold(hist, policy, param);
+}
 
-	uint avg;
-	MPI_Allreduce(&sum, &avg, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+int thresfilter(pixel *buf, int const count, enum thres_policy policy, double param)
+{
+	int t = global_threshold(buf, count, policy, param);
+	unsigned char lut[HIST_BINS];
+	thres_lut(t, lut);
 
 	// Set values for all my pixels
-	for (int i = 0; i < count; ++i)
-	{
-		uint psum = (uint)buf[i].r + (uint)buf[i].g + (uint)buf[i].b;
-		if (avg > psum)
-			buf[i].r = buf[i].g = buf[i].b = 0;
-		else
-			buf[i].r = buf[i].g = buf[i].b = 255;
-	}
+	phase_begin(PHASE_APPLY);
+	thres_apply(&buf->r, count, lut);
+	phase_end();
+	return t;
+}
+
+int thresfilter_pbm(pixel *buf, int const xsize, int const rows, enum thres_policy policy, double param, unsigned char *bits)
+{
+	int t = global_threshold(buf, xsize * rows, policy, param);
+
+	// Pack my rows, buf is left alone
+	phase_begin(PHASE_APPLY);
+	for (int y = 0; y < rows; ++y)
+		thres_pack(&buf[(size_t)y * xsize].r, xsize, t, bits + (size_t)y * PBM_ROW_BYTES(xsize));
+	phase_end();
+	return t;
 }
@@ -6,10 +6,19 @@
 #ifndef _THRESFILTER_H_
 #define _THRESFILTER_H_
 
+#include "../histogram.h"
+
 /* NOTE: This structure must not be padded! */
 typedef struct _pixel {
 	unsigned char r,g,b;
 } pixel;
 
-void thresfilter(pixel* buf, int const count, int const N);
+/* Thresholds the count pixels of buf, using the histogram of all processes
+   and the given policy. Collective. Returns the threshold. */
+int thresfilter(pixel* buf, int const count, enum thres_policy policy, double param);
+
+/* As thresfilter on rows rows of xsize pixels, but buf is left alone and
+   the result goes to bits as bit-packed PBM (P4) rows of
+   PBM_ROW_BYTES(xsize) bytes. Collective. Returns the threshold. */
+int thresfilter_pbm(pixel* buf, int const xsize, int const rows, enum thres_policy policy, double param, unsigned char *bits);
 #endif
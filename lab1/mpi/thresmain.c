@@ -2,8 +2,12 @@
 #include <stdio.h>
 #include <string.h>
 #include <time.h>
-#include "../ppmio.h"
+#include <unistd.h>
+#include "ppmio_mpi.h"
+#include "halo.h"
 #include "thresfilter.h"
+#include "../imgbuf.h"
+#include "../phases.h"
 #include <mpi.h>
 
 int main(int argc, char **argv)
@@ -12,79 +16,92 @@ int main(int argc, char **argv)
 	MPI_Init(&argc, &argv);
 	MPI_Comm_rank(MPI_COMM_WORLD, &me);
 	MPI_Comm_size(MPI_COMM_WORLD, &p);
+	phases_init(argv[0], me);
 
-	// The whole image (non-null only for P0)
-	pixel *src = NULL;
-	int xsize, ysize, N;
-	if (me == 0)
+	int xsize, ysize, colmax;
+	MPI_Offset offset;
+	enum thres_policy policy = THRES_MEAN;
+	double param = 0;
+	int pbm = 0;
+
+	/* Take care of the arguments */
+	int opt;
+	while ((opt = getopt(argc, argv, "p:b")) != -1)
 	{
-		src = (pixel *)malloc(sizeof(pixel) * MAX_PIXELS);
+		if (opt == 'b')
+			pbm = 1;
+		else if (opt != 'p' || parse_thres_policy(optarg, &policy, &param) != 0)
+			argc = 0;
+	}
+	// Drop the options, keeping the program name in argv[0]
+	argv[optind - 1] = argv[0];
+	argc -= optind - 1;
+	argv += optind - 1;
 
-		/* Take care of the arguments */
-		if (argc != 3)
+	if (argc != 3)
+	{
+		if (me == 0)
 		{
-			fprintf(stderr, "Usage: %s infile outfile\n", argv[0]);
-			exit(1);
+			fprintf(stderr, "Usage: %s [-p mean|otsu|percentile:P] [-b] infile outfile\n", argv[0]);
+			fprintf(stderr, "  -b: write a bit-packed PBM (P4) mask instead\n");
 		}
+		MPI_Finalize();
+		exit(1);
+	}
 
-		int colmax;
-		/* Read file */
-		if (read_ppm(argv[1], &xsize, &ysize, &colmax, (char *)src) != 0)
-			exit(1);
+	/* Read header on P0, broadcast to all processes */
+	phase_begin(PHASE_READ);
+	if (read_ppm_header_mpi(argv[1], MPI_COMM_WORLD, &xsize, &ysize, &colmax, &offset) != 0)
+		MPI_Abort(MPI_COMM_WORLD, 1);
 
-		if (colmax > 255)
-		{
+	if (colmax > 255)
+	{
+		if (me == 0)
 			fprintf(stderr, "Too large maximum color-component value\n");
-			exit(1);
-		}
-		N = xsize * ysize;
+		MPI_Abort(MPI_COMM_WORLD, 1);
 	}
 
-	// Start MPI code
-	double start_time = MPI_Wtime();
+	// Every process owns a block of whole rows
+	int y0, y1;
+	row_block(me, p, ysize, &y0, &y1);
+	int rows = y1 - y0;
 
-	// Broadcast the pixel count
-	int status;
-	status = MPI_Bcast(&N, 1, MPI_INT, 0, MPI_COMM_WORLD);
+	/* Every process reads its own part of the image */
+	pixel *buf = imgbuf_get(sizeof(pixel) * rows * xsize);
+	if (read_ppm_rows_mpi(argv[1], MPI_COMM_WORLD, offset, xsize, y0, rows, (char *)buf) != 0)
+		MPI_Abort(MPI_COMM_WORLD, 1);
+	phase_end();
 
-	int *sendcounts = (int *)malloc(p * sizeof(int));
-	int *displs = (int *)malloc(p * sizeof(int));
+	// Start MPI code
+	double start_time = MPI_Wtime();
 
-	// Compute the send counts and their offsets
-	int chunksize = N / p;
-	for (int i = 0; i < p; ++i)
+	// Apply the filter on our part of the image, or pack it to 1 bit per
+	// pixel so that the write below moves 24 times less data
+	unsigned char *bits = NULL;
+	int t;
+	if (pbm)
 	{
-		sendcounts[i] = chunksize;
-		if (i == p - 1)
-			sendcounts[i] += N % p;
-		sendcounts[i] *= 3;
-		displs[i] = 3 * i * chunksize;
+		bits = imgbuf_get((size_t)PBM_ROW_BYTES(xsize) * rows);
+		t = thresfilter_pbm(buf, xsize, rows, policy, param, bits);
 	}
-
-	// Distribute chunks of the image accross the processes
-	pixel *buf = malloc(sizeof(unsigned char) * sendcounts[me]);
-	status = MPI_Scatterv(src, sendcounts, displs, MPI_UNSIGNED_CHAR, buf, sendcounts[me], MPI_UNSIGNED_CHAR, 0, MPI_COMM_WORLD);
-
-	// Apply the filter on our part of the image
-	thresfilter(buf, sendcounts[me] / 3, N);
-
-	// Reassemble the image from the filtered parts
-	status = MPI_Gatherv(buf, sendcounts[me], MPI_UNSIGNED_CHAR, src, sendcounts, displs, MPI_UNSIGNED_CHAR, 0, MPI_COMM_WORLD);
+	else
+		t = thresfilter(buf, rows * xsize, policy, param);
 
 	if (me == 0) {
 		double end_time = MPI_Wtime();
 		printf("Process %d MPI code took %f\n", me, end_time - start_time);
+		printf("Threshold: %d\n", t);
+		printf("Writing output file\n");
 	}
 
-	MPI_Finalize();
+	/* Every process writes its own part of the image */
+	phase_begin(PHASE_WRITE);
+	if (pbm ? write_pbm_rows_mpi(argv[2], MPI_COMM_WORLD, xsize, ysize, y0, rows, (char *)bits) != 0
+	        : write_ppm_rows_mpi(argv[2], MPI_COMM_WORLD, xsize, ysize, y0, rows, (char *)buf) != 0)
+		MPI_Abort(MPI_COMM_WORLD, 1);
+	phase_end();
 
-	if (me == 0)
-	{
-		printf("Writing output file\n");
-		if (write_ppm(argv[2], xsize, ysize, (char *)src) != 0)
-		{
-			printf("Failed to write!\n");
-			exit(1);
-		}
-	}
+	imgbuf_put(bits);
+	imgbuf_put(buf);
+	MPI_Finalize();
 }
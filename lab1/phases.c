@@ -0,0 +1,233 @@
+/*
+  File: phases.c
+
+  Implementation of the per-phase timing. A log holds the time and counter
+  totals of one thread; a small stack of open phases makes the times
+  exclusive, so a barrier inside a pass is charged to waiting only.
+
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "phases.h"
+
+/* Deepest nesting of phases; going past it is a bug in the caller */
+#define MAX_DEPTH 8
+#define NUM_COUNTERS 3
+#define CACHE_LINE 64
+
+static const char *phase_names[NUM_PHASES] = {
+  "read", "weights", "hpass", "vpass", "resample", "hist", "apply", "wait", "comm", "write"
+};
+
+/* cycles, instructions, cache misses: the group leader comes first */
+static const uint64_t counter_config[NUM_COUNTERS] = {
+  PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES
+};
+
+typedef struct {
+  const char *role;
+  int index;
+  int fd[NUM_COUNTERS];           /* -1 without counters */
+  int depth;
+  enum phase stack[MAX_DEPTH];
+  double last;                    /* clock at the last transition */
+  uint64_t last_count[NUM_COUNTERS];
+  double secs[NUM_PHASES];
+  long calls[NUM_PHASES];
+  uint64_t count[NUM_PHASES][NUM_COUNTERS];
+} phase_log;
+
+static enum { STATS_OFF, STATS_TIME, STATS_PERF } stats_mode;
+static const char *stats_binary;
+static int stats_rank;
+static int perf_warned;
+static phase_log *main_log;
+static __thread phase_log *self;
+
+double phase_clock(void) {
+  struct timespec t;
+
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + 1e-9 * t.tv_nsec;
+}
+
+/* Counters of the calling thread only, user space, running from now on. */
+static void open_counters(phase_log *log) {
+  struct perf_event_attr attr;
+  int i;
+
+  for (i = 0; i < NUM_COUNTERS; i++) {
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = counter_config[i];
+    attr.read_format = PERF_FORMAT_GROUP;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    log->fd[i] = syscall(SYS_perf_event_open, &attr, 0, -1, i == 0 ? -1 : log->fd[0], 0);
+    if (log->fd[i] < 0) {
+      if (!__atomic_exchange_n(&perf_warned, 1, __ATOMIC_RELAXED))
+        perror("perf_event_open, reporting times only");
+      while (i-- > 0)
+        close(log->fd[i]);
+      log->fd[0] = -1;
+      return;
+    }
+  }
+}
+
+static void read_counters(phase_log *log, uint64_t *count) {
+  uint64_t buf[1 + NUM_COUNTERS];
+
+  if (log->fd[0] < 0 || read(log->fd[0], buf, sizeof(buf)) != sizeof(buf)) {
+    memset(count, 0, sizeof(uint64_t) * NUM_COUNTERS);
+    return;
+  }
+  memcpy(count, buf + 1, sizeof(uint64_t) * NUM_COUNTERS);
+}
+
+/* Charges everything since the last transition to the innermost phase. */
+static void transition(phase_log *log) {
+  double now = phase_clock();
+  uint64_t count[NUM_COUNTERS];
+  int i;
+
+  if (stats_mode == STATS_PERF)
+    read_counters(log, count);
+  if (log->depth > 0) {
+    enum phase p = log->stack[log->depth - 1];
+    log->secs[p] += now - log->last;
+    if (stats_mode == STATS_PERF)
+      for (i = 0; i < NUM_COUNTERS; i++)
+        log->count[p][i] += count[i] - log->last_count[i];
+  }
+  log->last = now;
+  if (stats_mode == STATS_PERF)
+    memcpy(log->last_count, count, sizeof(count));
+}
+
+static phase_log *new_log(const char *role, int index) {
+  phase_log *log = calloc(1, sizeof(phase_log));
+
+  log->role = role;
+  log->index = index;
+  log->fd[0] = -1;
+  if (stats_mode == STATS_PERF)
+    open_counters(log);
+  return log;
+}
+
+/* One JSON line, written at once so the records of ranks do not mix */
+static void print_log(phase_log *log) {
+  char line[4096];
+  int len, p, first = 1;
+
+  len = snprintf(line, sizeof(line), "{\"binary\":\"%s\",\"rank\":%d,\"thread\":\"%s\",\"index\":%d,\"phases\":{",
+                 stats_binary, stats_rank, log->role, log->index);
+  for (p = 0; p < NUM_PHASES; p++) {
+    if (log->calls[p] == 0 && log->secs[p] == 0)
+      continue;
+    len += snprintf(line + len, sizeof(line) - len, "%s\"%s\":{\"calls\":%ld,\"secs\":%.9f",
+                    first ? "" : ",", phase_names[p], log->calls[p], log->secs[p]);
+    if (stats_mode == STATS_PERF && log->fd[0] >= 0)
+      len += snprintf(line + len, sizeof(line) - len,
+                      ",\"cycles\":%llu,\"instructions\":%llu,\"llc_misses\":%llu,\"llc_bytes\":%llu",
+                      (unsigned long long)log->count[p][0], (unsigned long long)log->count[p][1],
+                      (unsigned long long)log->count[p][2], (unsigned long long)log->count[p][2] * CACHE_LINE);
+    else if (stats_mode == STATS_PERF)
+      len += snprintf(line + len, sizeof(line) - len,
+                      ",\"cycles\":null,\"instructions\":null,\"llc_misses\":null,\"llc_bytes\":null");
+    len += snprintf(line + len, sizeof(line) - len, "}");
+    first = 0;
+  }
+  len += snprintf(line + len, sizeof(line) - len, "}}\n");
+  if (write(STDERR_FILENO, line, len) != len)
+    return;
+}
+
+static void free_log(phase_log *log) {
+  int i;
+
+  for (i = 0; i < NUM_COUNTERS && log->fd[0] >= 0; i++)
+    close(log->fd[i]);
+  free(log);
+}
+
+static void end_main(void) {
+  if (main_log == NULL)
+    return;
+  print_log(main_log);
+  free_log(main_log);
+  main_log = NULL;
+  self = NULL;
+}
+
+void phases_init(const char *binary, int rank) {
+  const char *env = getenv("FILTER_STATS");
+  const char *base = strrchr(binary, '/');
+
+  if (env == NULL || *env == '\0')
+    return;
+  if (strcmp(env, "perf") == 0)
+    stats_mode = STATS_PERF;
+  else
+    stats_mode = STATS_TIME;
+  stats_binary = base != NULL ? base + 1 : binary;
+  stats_rank = rank;
+
+  main_log = self = new_log("main", 0);
+  atexit(end_main);
+}
+
+void phases_thread_start(const char *role, int index) {
+  if (stats_mode != STATS_OFF)
+    self = new_log(role, index);
+}
+
+void phases_thread_end(void) {
+  if (self == NULL)
+    return;
+  print_log(self);
+  free_log(self);
+  self = NULL;
+}
+
+void phase_begin(enum phase phase) {
+  phase_log *log = self;
+
+  if (log == NULL)
+    return;
+  if (log->depth == MAX_DEPTH) {
+    fprintf(stderr, "phase_begin: phases nested deeper than %d\n", MAX_DEPTH);
+    abort();
+  }
+  transition(log);
+  log->stack[log->depth++] = phase;
+  log->calls[phase]++;
+}
+
+void phase_end(void) {
+  phase_log *log = self;
+
+  if (log == NULL)
+    return;
+  if (log->depth == 0) {
+    fprintf(stderr, "phase_end: no phase is open\n");
+    abort();
+  }
+  transition(log);
+  log->depth--;
+}
+
+void phase_add(enum phase phase, double secs) {
+  if (self != NULL)
+    self->secs[phase] += secs;
+}
@@ -0,0 +1,55 @@
+/*
+  File: phases.h
+
+  Per-phase timing and hardware counters for the filter binaries. Every
+  thread (or MPI rank) keeps its own log of where its time went; at exit
+  each log is printed as one JSON line on stderr.
+
+  Enabled by the environment:
+    FILTER_STATS=time   wall time per phase
+    FILTER_STATS=perf   also cycles, instructions and last level cache
+                        misses per phase, read with perf_event_open
+  Unset, every call below returns at once.
+
+ */
+
+#ifndef _PHASES_H_
+#define _PHASES_H_
+
+enum phase {
+  PHASE_READ,     /* reading or mapping the input */
+  PHASE_WEIGHTS,  /* gaussian weights and derived tables */
+  PHASE_HPASS,    /* horizontal blur pass */
+  PHASE_VPASS,    /* vertical blur pass */
+  PHASE_RESAMPLE, /* pyramid octave downsampling and bias */
+  PHASE_HIST,     /* threshold histogram */
+  PHASE_APPLY,    /* binarising the pixels */
+  PHASE_WAIT,     /* barriers and waiting for the slowest worker */
+  PHASE_COMM,     /* MPI messages and collectives */
+  PHASE_WRITE,    /* writing the output */
+  NUM_PHASES
+};
+
+/* Reads FILTER_STATS and starts the log of the calling (main) thread,  */
+/* printed at exit. binary and rank label every record; call it first   */
+/* thing in main, before any worker is started.                         */
+void phases_init(const char *binary, int rank);
+
+/* Starts the log of the calling thread, labelled role and index.  */
+void phases_thread_start(const char *role, int index);
+
+/* Prints the log of the calling thread and drops it.  */
+void phases_thread_end(void);
+
+/* Time from phase_begin to the matching phase_end is charged to phase. */
+/* Phases nest; an inner phase's time is not counted for the outer one.  */
+void phase_begin(enum phase phase);
+void phase_end(void);
+
+/* Charges secs measured elsewhere to phase of the calling thread.  */
+void phase_add(enum phase phase, double secs);
+
+/* Monotonic clock in seconds.  */
+double phase_clock(void);
+
+#endif
@@ -7,17 +7,74 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <errno.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "ppmio.h"
 
+/* Read one ASCII integer of the header, skipping whitespace and comments. */
+static int read_header_int(FILE * fp, int * val) {
+  int ch;
+
+  do {
+    ch = getc(fp);
+    if (ch == '#')
+      while (ch != '\n' && ch != EOF)
+	ch = getc(fp);
+  } while (isspace(ch));
+
+  if (!isdigit(ch))
+    return 1;
+
+  *val = 0;
+  while (isdigit(ch)) {
+    *val = *val * 10 + (ch - '0');
+    ch = getc(fp);
+  }
+  /* The single whitespace after the last field belongs to the header */
+  if (!isspace(ch))
+    return 1;
+  return 0;
+}
+
+int read_pnm_header (FILE * fp, int * xpix, int * ypix, int * max,
+		     int * channels) {
+  char ftype[2] = { 0, 0 };
+
+  if (fread (ftype, 1, 2, fp) != 2 || ftype[0] != 'P'
+      || (ftype[1] != '6' && ftype[1] != '5')) {
+    fprintf (stderr, "Wrong file format: %.2s\n", ftype);
+    return 4;
+  }
+  *channels = ftype[1] == '6' ? 3 : 1;
+  if (read_header_int(fp, xpix) || read_header_int(fp, ypix)
+      || read_header_int(fp, max) || *xpix < 1 || *ypix < 1) {
+    fprintf (stderr, "Malformed %s header\n", *channels == 3 ? "PPM" : "PGM");
+    return 4;
+  }
+  return 0;
+}
+
+int read_ppm_header (FILE * fp, int * xpix, int * ypix, int * max) {
+  int channels, ret;
+
+  if ((ret = read_pnm_header (fp, xpix, ypix, max, &channels)) != 0)
+    return ret;
+  if (channels != 3) {
+    fprintf (stderr, "Wrong file format: P5, expected P6\n");
+    return 4;
+  }
+  return 0;
+}
+
 int read_ppm (const char * fname, 
 	       int * xpix, int * ypix, int * max, char * data) {
-  char ftype[40];
-  char ctype[40] = "P6";
-  char line[80];
-  int errno;
-
   FILE * fp;
-  errno = 0;
+  int ret;
+  size_t len;
 
   if (fname == NULL) fname = "\0";
   fp = fopen (fname, "r");
@@ -26,28 +83,23 @@ int read_ppm (const char * fname,
 	     strerror (errno));
     return 1;
   }
-  
-  fgets(line, 80, fp);
-  sscanf(line, "%s", ftype);
-
-  while (fgets(line, 80, fp) && (line[0] == '#'));
 
-  sscanf(line, "%d%d", xpix, ypix);
-  fscanf(fp, "%d\n", max);
+  if ((ret = read_ppm_header(fp, xpix, ypix, max)) != 0) {
+    fclose (fp);
+    return ret;
+  }
 
-  if(*xpix * *ypix > MAX_PIXELS) {
+  if((size_t)*xpix * *ypix > MAX_PIXELS) {
      fprintf (stderr, "Image size is too big\n");
+     fclose (fp);
     return 4;
  };
 
-  if (strncmp(ftype, ctype, 2) == 0) {
-    if (fread (data, sizeof (char), *xpix * *ypix * 3, fp) != 
-	*xpix * *ypix * 3) {
-      perror ("Read failed");
-      return 2;
-    }
-  } else {
-    fprintf (stderr, "Wrong file format: %s\n", ftype);
+  len = (size_t)*xpix * *ypix * 3;
+  if (fread (data, sizeof (char), len, fp) != len) {
+    perror ("Read failed");
+    fclose (fp);
+    return 2;
   }
 
   if (fclose (fp) == EOF) {
@@ -58,23 +110,116 @@ int read_ppm (const char * fname,
 
 }
 
+int map_ppm (const char * fname, ppm_map * img) {
+  FILE * fp;
+  struct stat st;
+  size_t offset, len;
+  int ret;
+
+  memset (img, 0, sizeof (*img));
+  if (fname == NULL) fname = "\0";
+  fp = fopen (fname, "r");
+  if (fp == NULL) {
+    fprintf (stderr, "map_ppm failed to open %s: %s\n", fname,
+	     strerror (errno));
+    return 1;
+  }
+
+  if ((ret = read_pnm_header(fp, &img->xsize, &img->ysize, &img->max,
+			     &img->channels)) != 0) {
+    fclose (fp);
+    return ret;
+  }
+
+  offset = ftell (fp);
+  len = (size_t)img->xsize * img->ysize * img->channels;
+  if (fstat (fileno (fp), &st) != 0 || (size_t)st.st_size < offset + len) {
+    fprintf (stderr, "map_ppm: %s is truncated\n", fname);
+    fclose (fp);
+    return 2;
+  }
+
+  /* Private writable mapping: filters may work in place, only the pages
+     they touch are copied and nothing goes back to the file. */
+  img->maplen = offset + len;
+  img->map = mmap (NULL, img->maplen, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+		   fileno (fp), 0);
+  fclose (fp);
+  if (img->map == MAP_FAILED) {
+    perror ("mmap failed");
+    img->map = NULL;
+    return 2;
+  }
+  img->data = (char *)img->map + offset;
+  return 0;
+}
+
+int unmap_ppm (ppm_map * img) {
+  if (img->map != NULL && munmap (img->map, img->maplen) != 0) {
+    perror ("munmap failed");
+    return 1;
+  }
+  img->map = NULL;
+  img->data = NULL;
+  return 0;
+}
+
+
+int write_ppm_header (FILE * fp, int xpix, int ypix) {
+  if (fprintf (fp, "P6\n%d %d 255\n", xpix, ypix) < 0) {
+    perror ("Write failed");
+    return 2;
+  }
+  return 0;
+}
 
 int write_ppm (const char * fname, int xpix, int ypix, char * data) {
+  return write_pnm (fname, xpix, ypix, 3, data);
+}
+
+int write_pnm (const char * fname, int xpix, int ypix, int channels,
+	       char * data) {
 
   FILE * fp;
-  int errno = 0;
+  size_t len = (size_t)xpix * ypix * channels;
 
   if (fname == NULL) fname = "\0";
   fp = fopen (fname, "w");
   if (fp == NULL) {
-    fprintf (stderr, "write_ppm failed to open %s: %s\n", fname,
+    fprintf (stderr, "write_pnm failed to open %s: %s\n", fname,
 	     strerror (errno));
     return 1;
   }
   
-  fprintf (fp, "P6\n");
-  fprintf (fp, "%d %d 255\n", xpix, ypix);
-  if (fwrite (data, sizeof (char), xpix*ypix*3, fp) != xpix*ypix*3) {
+  if (channels == 3 ? write_ppm_header (fp, xpix, ypix) != 0
+      : fprintf (fp, "P5\n%d %d 255\n", xpix, ypix) < 0)
+    return 2;
+  if (fwrite (data, sizeof (char), len, fp) != len) {
+    perror ("Write failed");
+    return 2;
+  }
+  if (fclose (fp) == EOF) {
+    perror ("Close failed");
+    return 3;
+  }
+  return 0;
+}
+
+int write_pbm (const char * fname, int xpix, int ypix, char * bits) {
+
+  FILE * fp;
+  size_t len = (size_t)(xpix + 7) / 8 * ypix;
+
+  if (fname == NULL) fname = "\0";
+  fp = fopen (fname, "w");
+  if (fp == NULL) {
+    fprintf (stderr, "write_pbm failed to open %s: %s\n", fname,
+	     strerror (errno));
+    return 1;
+  }
+
+  if (fprintf (fp, "P4\n%d %d\n", xpix, ypix) < 0
+      || fwrite (bits, sizeof (char), len, fp) != len) {
     perror ("Write failed");
     return 2;
   }
@@ -84,3 +229,11 @@ int write_ppm (const char * fname, int xpix, int ypix, char * data) {
   }
   return 0;
 }
+
+void rgb_to_luma (const char * rgb, char * gray, size_t count) {
+  const unsigned char * in = (const unsigned char *)rgb;
+  size_t i;
+
+  for (i = 0; i < count; i++, in += 3)
+    gray[i] = (77 * in[0] + 150 * in[1] + 29 * in[2] + 128) >> 8;
+}
@@ -7,6 +7,9 @@
 #ifndef _PPMIO_H_
 #define _PPMIO_H_
 
+#include <stdio.h>
+#include <stddef.h>
+
 /* maximum number of pixels in a picture */
 #define MAX_PIXELS (3000*3000)
 
@@ -21,6 +24,64 @@
 int read_ppm (const char * fname, 
 	       int * xpix, int * ypix, int * max, char * data);
 
+/* Function: read_pnm_header - parses the header of a PPM (P6) or PGM (P5)
+   file.
+   Input: fp - stream positioned at the start of the file.
+   Output:
+      xpix, ypix - size of the image in x & y directions
+      max - maximum intensity in the picture
+      channels - 3 for P6 (r,g,b per pixel), 1 for P5 (gray per pixel)
+      Comment lines are skipped wherever they appear. On success fp is
+      positioned at the first byte of the pixel data.
+   Returns: 0 on success.
+ */
+int read_pnm_header (FILE * fp, int * xpix, int * ypix, int * max,
+		     int * channels);
+
+/* Function: read_ppm_header - parses the header of a PPM (P6) file.
+   Input: fp - stream positioned at the start of the file.
+   Output:
+      xpix, ypix - size of the image in x & y directions
+      max - maximum intensity in the picture
+      Comment lines are skipped wherever they appear. On success fp is
+      positioned at the first byte of the pixel data.
+   Returns: 0 on success.
+ */
+int read_ppm_header (FILE * fp, int * xpix, int * ypix, int * max);
+
+/* A PPM or PGM file mapped into memory. data points straight into the
+   mapping. */
+typedef struct {
+  int xsize, ysize, max;
+  int channels;       /* 3 for PPM, 1 for PGM */
+  char * data;        /* xsize*ysize*channels bytes of pixel data */
+  void * map;         /* start of the mapping */
+  size_t maplen;
+} ppm_map;
+
+/* Function: map_ppm - maps an image file in PPM or PGM format into memory.
+   Input: fname - name of an image file in PPM or PGM format to map.
+   Output:
+      img - size, maximum intensity and a writable view of the color
+            data. Writes are private to the process and never reach the
+            file. There is no size limit besides the address space.
+   Returns: 0 on success.
+ */
+int map_ppm (const char * fname, ppm_map * img);
+
+/* Function: unmap_ppm - releases a mapping made by map_ppm.
+   Returns: 0 on success.
+ */
+int unmap_ppm (ppm_map * img);
+
+/* Function: write_ppm_header - writes the header of a PPM (P6) file.
+   Input:
+      fp - stream to write to.
+      xpix, ypix - size of the image in x & y directions
+   Returns: 0 on success. The color data is expected to follow.
+ */
+int write_ppm_header (FILE * fp, int xpix, int ypix);
+
 /* Function: write_ppm - write out an image file in PPM format.
    Input: 
       fname - name of an image file in PPM format to write.
@@ -30,4 +91,32 @@ int read_ppm (const char * fname,
  */
 int write_ppm (const char * fname, int xpix, int ypix, char * data);
 
+/* Function: write_pnm - write out an image file in PPM or PGM format.
+   Input:
+      fname - name of the image file to write.
+      xpix, ypix - size of the image in x & y directions
+      channels - 3 writes PPM (P6), 1 writes PGM (P5)
+      data - xpix*ypix*channels bytes of pixel data.
+   Returns: 0 on success.
+ */
+int write_pnm (const char * fname, int xpix, int ypix, int channels,
+	       char * data);
+
+/* Function: write_pbm - write out a bit-packed PBM (P4) image file.
+   Input:
+      fname - name of the image file to write.
+      xpix, ypix - size of the image in x & y directions
+      bits - ypix rows of (xpix+7)/8 bytes, most significant bit first,
+             a set bit is black.
+   Returns: 0 on success.
+ */
+int write_pbm (const char * fname, int xpix, int ypix, char * bits);
+
+/* Function: rgb_to_luma - converts packed r,g,b pixels to gray.
+   Input: rgb - count pixels of r,g,b bytes.
+   Output: gray - count bytes of (77*r + 150*g + 29*b + 128) / 256, the
+      ITU-R BT.601 luma; r = g = b = v converts to v exactly.
+ */
+void rgb_to_luma (const char * rgb, char * gray, size_t count);
+
 #endif
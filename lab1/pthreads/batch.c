@@ -0,0 +1,291 @@
+/*
+  File: batch.c
+  Batch runner. Images move through a ring of buffers: a reader thread
+  fills them in job order, the calling thread runs the pipeline on the
+  pool and a writer thread empties them, so I/O of one image overlaps the
+  filtering of the next.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <time.h>
+#include "batch.h"
+#include "../phases.h"
+#include "../imgbuf.h"
+#include "../ppmio.h"
+
+struct batch_source
+{
+	FILE *list;           // job list, or NULL for a directory
+	struct dirent **names; // sorted *.ppm entries of the directory
+	int num_names, next;
+	char *indir, *outdir;
+	char *line;
+	size_t linecap;
+};
+
+enum slot_state
+{
+	SLOT_FREE,
+	SLOT_READ,    // holds an input image, or a failed/final job
+	SLOT_FILTERED // holds an output image
+};
+
+typedef struct
+{
+	enum slot_state state;
+	int end;    // no job, the source is exhausted
+	int failed; // the job failed and is only to be counted
+	char *infile, *outfile;
+	int xsize, ysize;
+	char *data;
+	size_t cap; // bytes allocated for data, grown to the largest image
+} batch_slot;
+
+typedef struct
+{
+	batch_source *src;
+	batch_slot *slot;
+	int num_slots;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	batch_stats *stats;
+} batch_ring;
+
+static int is_ppm(const struct dirent *d)
+{
+	size_t len = strlen(d->d_name);
+	return len > 4 && strcmp(d->d_name + len - 4, ".ppm") == 0;
+}
+
+batch_source *batch_open_dir(const char *indir, const char *outdir)
+{
+	batch_source *src = calloc(1, sizeof(batch_source));
+	src->num_names = scandir(indir, &src->names, is_ppm, alphasort);
+	if (src->num_names < 0)
+	{
+		perror("batch_open_dir failed to scan input directory");
+		free(src);
+		return NULL;
+	}
+	src->indir = strdup(indir);
+	src->outdir = strdup(outdir);
+	return src;
+}
+
+batch_source *batch_open_list(const char *fname)
+{
+	batch_source *src = calloc(1, sizeof(batch_source));
+	src->list = strcmp(fname, "-") == 0 ? stdin : fopen(fname, "r");
+	if (src->list == NULL)
+	{
+		perror("batch_open_list failed to open job list");
+		free(src);
+		return NULL;
+	}
+	return src;
+}
+
+void batch_close(batch_source *src)
+{
+	if (src->list != NULL && src->list != stdin)
+		fclose(src->list);
+	for (int i = 0; i < src->num_names; ++i)
+		free(src->names[i]);
+	free(src->names);
+	free(src->indir);
+	free(src->outdir);
+	free(src->line);
+	free(src);
+}
+
+static char *join_path(const char *dir, const char *name)
+{
+	char *path = malloc(strlen(dir) + strlen(name) + 2);
+	sprintf(path, "%s/%s", dir, name);
+	return path;
+}
+
+// Next job of src into infile and outfile (malloced). Returns 0 at the end.
+static int next_job(batch_source *src, char **infile, char **outfile)
+{
+	if (src->list == NULL)
+	{
+		if (src->next == src->num_names)
+			return 0;
+		const char *name = src->names[src->next++]->d_name;
+		*infile = join_path(src->indir, name);
+		*outfile = join_path(src->outdir, name);
+		return 1;
+	}
+
+	while (getline(&src->line, &src->linecap, src->list) != -1)
+	{
+		char *save;
+		char *in = strtok_r(src->line, " \t\r\n", &save);
+		if (in == NULL || in[0] == '#')
+			continue;
+		char *out = strtok_r(NULL, " \t\r\n", &save);
+		if (out == NULL)
+		{
+			fprintf(stderr, "Job %s has no output file, skipped\n", in);
+			continue;
+		}
+		*infile = strdup(in);
+		*outfile = strdup(out);
+		return 1;
+	}
+	return 0;
+}
+
+// Reads the image of the slot's job into its buffer. Returns 0 on success.
+static int read_image(batch_slot *s)
+{
+	int colmax, ret = 0;
+	FILE *fp = fopen(s->infile, "r");
+	if (fp == NULL)
+	{
+		perror(s->infile);
+		return 1;
+	}
+	if (read_ppm_header(fp, &s->xsize, &s->ysize, &colmax) != 0)
+		ret = 4;
+	else if (colmax > 255)
+	{
+		fprintf(stderr, "%s: Too large maximum color-component value\n", s->infile);
+		ret = 4;
+	}
+	else
+	{
+		size_t len = (size_t)s->xsize * s->ysize * 3;
+		if (len > s->cap)
+		{
+			imgbuf_put(s->data);
+			s->data = imgbuf_get(len);
+			s->cap = s->data != NULL ? len : 0;
+		}
+		if (s->data == NULL || fread(s->data, 1, len, fp) != len)
+		{
+			fprintf(stderr, "%s: Read failed\n", s->infile);
+			ret = 2;
+		}
+	}
+	fclose(fp);
+	return ret;
+}
+
+// Waits until slot s is in state, with the ring locked
+static batch_slot *wait_slot(batch_ring *ring, int s, enum slot_state state)
+{
+	pthread_mutex_lock(&ring->lock);
+	while (ring->slot[s].state != state)
+		pthread_cond_wait(&ring->cond, &ring->lock);
+	pthread_mutex_unlock(&ring->lock);
+	return &ring->slot[s];
+}
+
+static void set_slot(batch_ring *ring, batch_slot *slot, enum slot_state state)
+{
+	pthread_mutex_lock(&ring->lock);
+	slot->state = state;
+	pthread_cond_broadcast(&ring->cond);
+	pthread_mutex_unlock(&ring->lock);
+}
+
+static void *reader(void *arg)
+{
+	batch_ring *ring = arg;
+
+	phases_thread_start("reader", 0);
+	for (int s = 0;; s = (s + 1) % ring->num_slots)
+	{
+		batch_slot *slot = wait_slot(ring, s, SLOT_FREE);
+		phase_begin(PHASE_READ);
+		slot->end = !next_job(ring->src, &slot->infile, &slot->outfile);
+		slot->failed = !slot->end && read_image(slot) != 0;
+		phase_end();
+		set_slot(ring, slot, SLOT_READ);
+		if (slot->end)
+		{
+			phases_thread_end();
+			return NULL;
+		}
+	}
+}
+
+static void *writer(void *arg)
+{
+	batch_ring *ring = arg;
+
+	phases_thread_start("writer", 0);
+	for (int s = 0;; s = (s + 1) % ring->num_slots)
+	{
+		batch_slot *slot = wait_slot(ring, s, SLOT_FILTERED);
+		if (slot->end)
+		{
+			phases_thread_end();
+			return NULL;
+		}
+
+		phase_begin(PHASE_WRITE);
+		if (!slot->failed && write_ppm(slot->outfile, slot->xsize, slot->ysize, slot->data) != 0)
+			slot->failed = 1;
+		phase_end();
+		if (slot->failed)
+		{
+			fprintf(stderr, "Job %s failed\n", slot->infile);
+			ring->stats->failed++;
+		}
+		else
+			printf("Wrote %s\n", slot->outfile);
+		ring->stats->images++;
+
+		free(slot->infile);
+		free(slot->outfile);
+		set_slot(ring, slot, SLOT_FREE);
+	}
+}
+
+void batch_run(filter_pipeline *pipe, batch_source *src, const int in_flight, batch_stats *stats)
+{
+	struct timespec stime, etime;
+	batch_ring ring;
+	pthread_t rd, wr;
+
+	ring.src = src;
+	ring.num_slots = in_flight;
+	ring.slot = calloc(in_flight, sizeof(batch_slot));
+	ring.stats = stats;
+	pthread_mutex_init(&ring.lock, NULL);
+	pthread_cond_init(&ring.cond, NULL);
+	memset(stats, 0, sizeof(batch_stats));
+
+	clock_gettime(CLOCK_REALTIME, &stime);
+	pthread_create(&rd, NULL, reader, &ring);
+	pthread_create(&wr, NULL, writer, &ring);
+
+	// Filter in job order on the calling thread, which owns the pool
+	for (int s = 0;; s = (s + 1) % in_flight)
+	{
+		batch_slot *slot = wait_slot(&ring, s, SLOT_READ);
+		if (!slot->end && !slot->failed)
+			slot->failed = pipeline_run(pipe, slot->xsize, slot->ysize, (pixel *)slot->data) != 0;
+		set_slot(&ring, slot, SLOT_FILTERED);
+		if (slot->end)
+			break;
+	}
+
+	pthread_join(rd, NULL);
+	pthread_join(wr, NULL);
+	clock_gettime(CLOCK_REALTIME, &etime);
+	stats->secs = (etime.tv_sec - stime.tv_sec) + 1e-9 * (etime.tv_nsec - stime.tv_nsec);
+
+	for (int s = 0; s < in_flight; ++s)
+		imgbuf_put(ring.slot[s].data);
+	free(ring.slot);
+	pthread_mutex_destroy(&ring.lock);
+	pthread_cond_destroy(&ring.cond);
+}
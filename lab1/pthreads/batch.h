@@ -0,0 +1,38 @@
+/*
+  File: batch.h
+  Declaration of the batch runner: many images through one pipeline, with
+  reading, filtering and writing overlapped.
+ */
+
+#ifndef _BATCH_H_
+#define _BATCH_H_
+
+#include "pipeline.h"
+
+typedef struct batch_source batch_source;
+
+/* Jobs for every *.ppm file in indir, in name order, each written under
+   the same name to outdir. NULL on error. */
+batch_source *batch_open_dir(const char *indir, const char *outdir);
+
+/* Jobs from a list with one "infile outfile" pair per line; empty lines
+   and lines starting with # are skipped. "-" reads stdin. Lines are read
+   only as the jobs are needed, so a pipe or FIFO works as a job queue.
+   NULL on error. */
+batch_source *batch_open_list(const char *fname);
+
+void batch_close(batch_source *src);
+
+typedef struct
+{
+	int images, failed;
+	double secs; // wall time from the first read to the last write
+} batch_stats;
+
+/* Runs every job of src through pipe. One thread reads images ahead,
+   pipe's workers filter them and another thread writes them out, with up
+   to in_flight images held at once in buffers reused across jobs.
+   A job that fails is reported and skipped. */
+void batch_run(filter_pipeline *pipe, batch_source *src, const int in_flight, batch_stats *stats);
+
+#endif
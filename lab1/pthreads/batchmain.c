@@ -0,0 +1,74 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include "batch.h"
+#include "../phases.h"
+
+int main(int argc, char **argv)
+{
+	const char *list = NULL;
+	int in_flight = 3;
+
+	phases_init(argv[0], 0);
+
+	/* Take care of the arguments */
+	int opt;
+	while ((opt = getopt(argc, argv, "l:n:")) != -1)
+	{
+		switch (opt)
+		{
+		case 'l':
+			list = optarg;
+			break;
+		case 'n':
+			in_flight = atoi(optarg);
+			if (in_flight < 1)
+			{
+				fprintf(stderr, "Images in flight (%d) must be greater than zero\n", in_flight);
+				exit(1);
+			}
+			break;
+		default:
+			argc = 0;
+		}
+	}
+	// Drop the options, keeping the program name in argv[0]
+	argv[optind - 1] = argv[0];
+	argc -= optind - 1;
+	argv += optind - 1;
+
+	if (argc != (list != NULL ? 3 : 5))
+	{
+		fprintf(stderr, "Usage: %s [-n in_flight] threads stages {-l joblist | indir outdir}\n", argv[0]);
+		fprintf(stderr, "  stages: comma separated blur:RADIUS and thres:mean|otsu|percentile:P, e.g. blur:5,thres:otsu\n");
+		fprintf(stderr, "  joblist: one \"infile outfile\" pair per line, - for stdin\n");
+		exit(1);
+	}
+
+	int threads = atoi(argv[1]);
+	if (threads < 1)
+	{
+		fprintf(stderr, "Threads (%d) must be greater than zero\n", threads);
+		exit(1);
+	}
+
+	batch_source *src = list != NULL ? batch_open_list(list) : batch_open_dir(argv[3], argv[4]);
+	if (src == NULL)
+		exit(1);
+
+	/* One set of workers, weights and buffers for all the images */
+	filter_pool *pool = pool_create(threads, 1);
+	filter_pipeline *pipe = pipeline_create(pool);
+	if (pipeline_parse(pipe, argv[2]) != 0)
+		exit(1);
+
+	batch_stats stats;
+	batch_run(pipe, src, in_flight, &stats);
+	printf("Processed %d images (%d failed) in %g secs: %g images/sec\n", stats.images, stats.failed, stats.secs,
+		   stats.secs > 0 ? (stats.images - stats.failed) / stats.secs : 0);
+
+	pipeline_destroy(pipe);
+	pool_destroy(pool);
+	batch_close(src);
+	return stats.failed != 0;
+}
@@ -1,18 +1,29 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include "blurfilter.h"
-#include "../ppmio.h"
-#include <pthread.h>
+#include "blurspecial.h"
+#include "../histogram.h"
+#include "../imgbuf.h"
+#include "../phases.h"
 
-pthread_barrier_t barrier;
+// Cache budget for the rows one column strip touches in the vertical pass
+#define STRIP_CACHE_BYTES (256 * 1024)
+#define MIN_STRIP 16
 
 typedef struct
 {
 	int xsize, ysize;
 	int radius;
 	pixel *src, *dst;
+	pixel *out;      // output rows [y0, y1) of the vertical pass
+	int y0, y1;
 	double const *weights;
-	int rank, num_threads;
+	int band, width; // rows per row tile, columns per column strip
+	double *acc;     // 3 * width accumulators per worker
+	reduction *hist; // output histogram per worker, or NULL
+	row_kernel row;  // specialised kernels for the radius, or NULL
+	col_kernel col;
+	double n;        // sum of all the weights
 } thread_args;
 
 pixel *pix(pixel *image, const int xx, const int yy, const int xsize)
@@ -21,112 +32,212 @@ pixel *pix(pixel *image, const int xx, const int yy, const int xsize)
 	return (image + off);
 }
 
-void compute_row(int y, thread_args *args)
+static void compute_pixel(int x, int y, thread_args *args)
 {
-	for (int x = 0; x < args->xsize; ++x)
+	double r = 0, g = 0, b = 0, n = 0;
+	for (int wi = -args->radius; wi <= args->radius; wi++)
 	{
-		double r = 0, g = 0, b = 0, n = 0;
-		for (int wi = -args->radius; wi <= args->radius; wi++)
+		double wc = args->weights[abs(wi)];
+		int x2 = x + wi;
+		if (x2 >= 0 && x2 < args->xsize)
 		{
-			double wc = args->weights[abs(wi)];
-			int x2 = x + wi;
-			if (x2 >= 0 && x2 < args->xsize)
-			{
-				r += wc * pix(args->src, x2, y, args->xsize)->r;
-				g += wc * pix(args->src, x2, y, args->xsize)->g;
-				b += wc * pix(args->src, x2, y, args->xsize)->b;
-				n += wc;
-			}
+			r += wc * pix(args->src, x2, y, args->xsize)->r;
+			g += wc * pix(args->src, x2, y, args->xsize)->g;
+			b += wc * pix(args->src, x2, y, args->xsize)->b;
+			n += wc;
 		}
+	}
+
+	pix(args->dst, x, y, args->xsize)->r = r / n;
+	pix(args->dst, x, y, args->xsize)->g = g / n;
+	pix(args->dst, x, y, args->xsize)->b = b / n;
+}
 
-		pix(args->dst, x, y, args->xsize)->r = r / n;
-		pix(args->dst, x, y, args->xsize)->g = g / n;
-		pix(args->dst, x, y, args->xsize)->b = b / n;
+void compute_row(int y, thread_args *args)
+{
+	// Pixels [x0, x1) have their whole window inside the row
+	int x0 = 0, x1 = 0;
+	if (args->row != NULL && args->xsize > 2 * args->radius)
+	{
+		x0 = args->radius;
+		x1 = args->xsize - args->radius;
+		args->row(pix(args->src, 0, y, args->xsize), pix(args->dst, 0, y, args->xsize), x0, x1, args->weights, args->n);
 	}
+
+	for (int x = 0; x < x0; ++x)
+		compute_pixel(x, y, args);
+	for (int x = x1; x < args->xsize; ++x)
+		compute_pixel(x, y, args);
+}
+
+// Width of the column strips so that the 2 * radius + 1 rows of a strip
+// stay in cache while the strip is walked downwards, yet there are enough
+// strips to balance the workers
+int strip_width(int radius, int xsize, int num_threads)
+{
+	int width = STRIP_CACHE_BYTES / (sizeof(pixel) * (2 * radius + 1));
+	int share = (xsize + TILES_PER_WORKER * num_threads - 1) / (TILES_PER_WORKER * num_threads);
+	if (share < width)
+		width = share + MIN_STRIP - 1;
+	width -= width % MIN_STRIP;
+	return width < MIN_STRIP ? MIN_STRIP : width;
 }
 
-void compute_col(int x, thread_args *args)
+// Computes the columns [x0, x1) for all rows. Each tap reads a contiguous
+// piece of a row instead of one pixel per row, and the rows of the strip are
+// reused from cache by the following output rows. With hist set, the
+// output pixels are counted into it while they are still in cache.
+void compute_cols(int x0, int x1, double *acc, uint64_t *hist, thread_args *args)
 {
-	for (int y = 0; y < args->ysize; ++y)
+	int width = x1 - x0;
+
+	for (int y = args->y0; y < args->y1; ++y)
 	{
+		pixel *out = pix(args->out, x0, y - args->y0, args->xsize);
+		if (args->col != NULL && y >= args->radius && y < args->ysize - args->radius)
+		{
+			args->col(pix(args->dst, x0, y - args->radius, args->xsize), out, args->xsize, width, args->weights, args->n);
+			if (hist != NULL)
+				hist_add(hist, &out->r, width);
+			continue;
+		}
+
+		double n = 0;
+		for (int i = 0; i < 3 * width; ++i)
+			acc[i] = 0;
 
-		double r = 0, g = 0, b = 0, n = 0;
 		for (int wi = -args->radius; wi <= args->radius; wi++)
 		{
 			double wc = args->weights[abs(wi)];
 			int y2 = y + wi;
 			if (y2 >= 0 && y2 < args->ysize)
 			{
-				r += wc * pix(args->dst, x, y2, args->xsize)->r;
-				g += wc * pix(args->dst, x, y2, args->xsize)->g;
-				b += wc * pix(args->dst, x, y2, args->xsize)->b;
+				pixel *row = pix(args->dst, x0, y2, args->xsize);
+				for (int i = 0; i < width; ++i)
+				{
+					acc[3 * i] += wc * row[i].r;
+					acc[3 * i + 1] += wc * row[i].g;
+					acc[3 * i + 2] += wc * row[i].b;
+				}
 				n += wc;
 			}
 		}
 
-		pix(args->src, x, y, args->xsize)->r = r / n;
-		pix(args->src, x, y, args->xsize)->g = g / n;
-		pix(args->src, x, y, args->xsize)->b = b / n;
+		for (int i = 0; i < width; ++i)
+		{
+			out[i].r = acc[3 * i] / n;
+			out[i].g = acc[3 * i + 1] / n;
+			out[i].b = acc[3 * i + 2] / n;
+		}
+		if (hist != NULL)
+			hist_add(hist, &out->r, width);
 	}
 }
 
-void *work(void *arg)
+// Compute the weighted row-wise averages for the rows of one band
+static void row_tile(void *arg, int tile, int rank)
 {
-	thread_args args = *(thread_args *)arg;
-
-	int thread_rows = args.ysize / args.num_threads;
-	int thread_cols = args.xsize / args.num_threads;
+	thread_args *args = arg;
+	int end_row = (tile + 1) * args->band < args->ysize ? (tile + 1) * args->band : args->ysize;
 
-	int start_row = args.rank * thread_rows;
-	int start_col = args.rank * thread_cols;
-
-	int end_row = start_row + thread_rows;
-	int end_col = start_col + thread_cols;
-
-	// Last thread does the remaining work
-	if (args.rank == args.num_threads - 1)
-	{
-		end_row += args.ysize % args.num_threads;
-		end_col += args.xsize % args.num_threads;
-	}
+	phase_begin(PHASE_HPASS);
+	for (int y = tile * args->band; y < end_row; ++y)
+		compute_row(y, args);
+	phase_end();
+}
 
-	// Compute the weighted row-wise averages for pixels of the assigned rows
-	for (int y = start_row; y < end_row; ++y)
-		compute_row(y, &args);
+// Compute the weighted column-wise averages for one cache-sized strip
+static void col_tile(void *arg, int tile, int rank)
+{
+	thread_args *args = arg;
+	int x0 = tile * args->width;
+	int x1 = x0 + args->width < args->xsize ? x0 + args->width : args->xsize;
+
+	uint64_t *hist = args->hist != NULL ? reduction_slot(args->hist, rank) : NULL;
+	phase_begin(PHASE_VPASS);
+	compute_cols(x0, x1, args->acc + (size_t)rank * 3 * args->width, hist, args);
+	phase_end();
+}
 
-	// Wait for all the row averages to be computed
-	pthread_barrier_wait(&barrier);
+static void merge_hist(void *arg, int rank, int num_threads)
+{
+	thread_args *args = arg;
+	reduction_combine(args->hist, rank, num_threads);
+}
 
-	// Compute the weighted column-wise averages for pixels of the assigned columns
-	for (int x = start_col; x < end_col; ++x)
-		compute_col(x, &args);
+void blurfilter_pool(filter_pool *pool, const int xsize, const int ysize, pixel *src, const int radius, const double *w)
+{
+	blurfilter_hist(pool, xsize, ysize, src, radius, w, NULL);
 }
 
-void blurfilter(const int xsize, const int ysize, pixel *src, const int radius, const double *w, const int thread_count)
+// Fills in everything but the images and rows
+static void init_args(thread_args *args, filter_pool *pool, const int xsize, const int ysize, const int radius, const double *w)
 {
-	pthread_barrier_init(&barrier, NULL, thread_count);
+	int num_threads = pool_size(pool);
+
+	args->xsize = xsize;
+	args->ysize = ysize;
+	args->radius = radius;
+	args->weights = w;
+	args->band = ysize / (TILES_PER_WORKER * num_threads);
+	if (args->band < 1)
+		args->band = 1;
+	args->width = strip_width(radius, xsize, num_threads);
+	args->acc = malloc(sizeof(double) * 3 * args->width * num_threads);
+	args->hist = NULL;
+	args->row = special_row_kernel(radius);
+	args->col = special_col_kernel(radius);
+	args->n = 0;
+	for (int wi = -radius; wi <= radius; wi++)
+		args->n += w[abs(wi)];
+}
 
-	pixel *dst = (pixel *)malloc(sizeof(pixel) * MAX_PIXELS);
+void blurfilter_hist(filter_pool *pool, const int xsize, const int ysize, pixel *src, const int radius, const double *w, reduction *hist)
+{
+	thread_args args;
+	init_args(&args, pool, xsize, ysize, radius, w);
+	args.src = src;
+	args.dst = (pixel *)imgbuf_get(sizeof(pixel) * xsize * ysize);
+	args.out = src;
+	args.y0 = 0;
+	args.y1 = ysize;
+	args.hist = hist;
+
+	// All row averages are done before pool_for returns
+	pool_for(pool, (ysize + args.band - 1) / args.band, row_tile, &args);
+	pool_for_finish(pool, (xsize + args.width - 1) / args.width, col_tile, hist != NULL ? merge_hist : NULL, &args);
+
+	free(args.acc);
+	imgbuf_put(args.dst);
+}
 
-	pthread_t *threads = malloc(sizeof(pthread_t) * thread_count);
-	for (int t = 0; t < thread_count; ++t)
-	{
-		thread_args *args = malloc(sizeof(thread_args));
-		args->xsize = xsize;
-		args->ysize = ysize;
-		args->radius = radius;
-		args->weights = w;
-		args->src = src;
-		args->dst = dst;
-		args->rank = t;
-		args->num_threads = thread_count;
-		pthread_create(&threads[t], NULL, work, args);
-	}
+void blurfilter_rows(filter_pool *pool, const int xsize, const int rows, pixel *src, pixel *dst, const int radius, const double *w)
+{
+	thread_args args;
+	init_args(&args, pool, xsize, rows, radius, w);
+	args.src = src;
+	args.dst = dst;
 
-	for (int t = 0; t < thread_count; ++t)
-		pthread_join(threads[t], NULL);
+	pool_for(pool, (rows + args.band - 1) / args.band, row_tile, &args);
+	free(args.acc);
+}
 
-	pthread_barrier_destroy(&barrier);
+void blurfilter_cols(filter_pool *pool, const int xsize, const int rows, pixel *src, const int y0, const int y1, pixel *dst, const int radius, const double *w)
+{
+	thread_args args;
+	init_args(&args, pool, xsize, rows, radius, w);
+	args.dst = src; // compute_cols reads the row averages from dst
+	args.out = dst;
+	args.y0 = y0;
+	args.y1 = y1;
+
+	pool_for(pool, (xsize + args.width - 1) / args.width, col_tile, &args);
+	free(args.acc);
+}
 
-	free(dst);
+void blurfilter(const int xsize, const int ysize, pixel *src, const int radius, const double *w, const int thread_count)
+{
+	filter_pool *pool = pool_create(thread_count, 1);
+	blurfilter_pool(pool, xsize, ysize, src, radius, w);
+	pool_destroy(pool);
 }
\ No newline at end of file
@@ -6,11 +6,27 @@
 #ifndef _BLURFILTER_H_
 #define _BLURFILTER_H_
 
-/* NOTE: This structure must not be padded! */
-typedef struct _pixel {
-	unsigned char r,g,b;
-} pixel;
+#include "pixel.h"
+#include "pool.h"
+#include "reduce.h"
 
+/* Blurs src in place on the workers of pool. */
+void blurfilter_pool(filter_pool *pool, const int xsize, const int ysize, pixel* src, const int radius, const double *w);
+
+/* Same as blurfilter_pool, and the vertical pass also counts the r+g+b of
+   every output pixel into hist (HIST_BINS counters per worker), so a
+   following threshold needs no pass of its own to build its histogram. */
+void blurfilter_hist(filter_pool *pool, const int xsize, const int ysize, pixel* src, const int radius, const double *w, reduction *hist);
+
+/* The two passes of blurfilter_pool on a block of rows, for callers that
+   distribute the image themselves. blurfilter_rows averages the rows of
+   src (rows high) along x into dst. blurfilter_cols averages the rows
+   [y0, y1) of src along y, clipping the window to the rows of src, into
+   the y1 - y0 rows of dst. */
+void blurfilter_rows(filter_pool *pool, const int xsize, const int rows, pixel *src, pixel *dst, const int radius, const double *w);
+void blurfilter_cols(filter_pool *pool, const int xsize, const int rows, pixel *src, const int y0, const int y1, pixel *dst, const int radius, const double *w);
+
+/* Same as blurfilter_pool on a pool that only lives for this call. */
 void blurfilter(const int xsize, const int ysize, pixel* src, const int radius, const double *w, const int thread_count);
 
 #endif
@@ -0,0 +1,252 @@
+/*
+  File: blurfixed.c
+  Fixed-point blurfilter. Both passes work on the interleaved bytes of a
+  row: tap k of byte i is byte i + 3 * k of the same row (horizontal) or
+  byte i of row y + k (vertical), so the inner loops are plain
+  multiply-adds of bytes by 16-bit weights into 32-bit sums.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "blurfixed.h"
+#include "blurspecial.h"
+#include "../imgbuf.h"
+#include "../phases.h"
+
+// Fraction bits of the reciprocal normalisation factors
+#define INV_SHIFT 48
+
+typedef struct
+{
+	int xsize, ysize, radius;
+	pixel *src, *dst;
+	uint16_t const *q;        // radius + 1 quantised weights
+	uint64_t const *inv_x, *inv_y; // 2^INV_SHIFT / in-image weight sum
+	uint32_t *acc;            // 3 * xsize sums per worker
+	int band;                 // rows per tile
+	struct fixed_kernels const *special; // kernels for the radius, or NULL
+} fixed_args;
+
+// Horizontal sums of the bytes [i0, i1) of a row and vertical sums of the
+// bytes [0, n) of the row at in, with the radius fixed at compile time.
+// Integer sums are exact, so the taps are folded around the centre.
+typedef struct fixed_kernels
+{
+	void (*row)(const unsigned char *in, uint32_t *acc, const int i0, const int i1, uint16_t const *q);
+	void (*col)(const unsigned char *in, unsigned char *out, const size_t stride, const int n, uint16_t const *q, const uint64_t inv);
+} fixed_kernels;
+
+#define FIXED_KERNELS(R) \
+	static void fixed_row_##R(const unsigned char *in, uint32_t *acc, const int i0, const int i1, uint16_t const *q) \
+	{ \
+		uint32_t qk[R + 1]; \
+		for (int k = 0; k <= R; ++k) \
+			qk[k] = q[k]; \
+		for (int i = i0; i < i1; ++i) \
+		{ \
+			uint32_t s = qk[0] * in[i]; \
+			_Pragma("GCC unroll 32") for (int k = 1; k <= R; ++k) \
+				s += qk[k] * (in[i - 3 * k] + in[i + 3 * k]); \
+			acc[i] = s; \
+		} \
+	} \
+	static void fixed_col_##R(const unsigned char *in, unsigned char *out, const size_t stride, const int n, uint16_t const *q, const uint64_t inv) \
+	{ \
+		uint32_t qk[R + 1]; \
+		for (int k = 0; k <= R; ++k) \
+			qk[k] = q[k]; \
+		for (int i = 0; i < n; ++i) \
+		{ \
+			uint32_t s = qk[0] * in[i]; \
+			_Pragma("GCC unroll 32") for (int k = 1; k <= R; ++k) \
+				s += qk[k] * (in[i - k * stride] + in[i + k * stride]); \
+			out[i] = (s * inv) >> INV_SHIFT; \
+		} \
+	}
+
+SPECIAL_RADII(FIXED_KERNELS)
+
+#define FIXED_ENTRY(R) [R] = {fixed_row_##R, fixed_col_##R},
+
+static const fixed_kernels special_kernels[MAX_SPECIAL_RADIUS + 1] = {SPECIAL_RADII(FIXED_ENTRY)};
+
+// Scales the weights so the largest uses all 16 bits, unless a full
+// window of 255s could then overflow the 32-bit sums
+static void quantise(const int radius, const double *w, uint16_t *q)
+{
+	double sum = w[0];
+	for (int i = 1; i <= radius; ++i)
+		sum += 2 * w[i];
+
+	double scale = UINT16_MAX / w[0];
+	double limit = (UINT32_MAX / 255 - (2 * radius + 1)) / sum;
+	if (scale > limit)
+		scale = limit;
+
+	for (int i = 0; i <= radius; ++i)
+		q[i] = w[i] * scale + 0.5;
+}
+
+// Reciprocal of the sum of the quantised weights that fall inside [0, len).
+// Away from the borders this is the same value for every position.
+static uint64_t *inv_norm(const int len, const int radius, const uint16_t *q)
+{
+	uint64_t *inv = malloc(sizeof(uint64_t) * len);
+	uint64_t full = q[0];
+	for (int i = 1; i <= radius; ++i)
+		full += 2 * q[i];
+
+	for (int i = 0; i < len; ++i)
+	{
+		uint64_t n = full;
+		for (int k = i + 1; k <= radius; ++k) // taps before the start
+			n -= q[k];
+		for (int k = len - i; k <= radius; ++k) // taps past the end
+			n -= q[k];
+		// Rounded up, so exact multiples of n do not truncate to one less
+		inv[i] = (((uint64_t)1 << INV_SHIFT) + n - 1) / n;
+	}
+	return inv;
+}
+
+// Sums of the taps of pixel x that fall inside the row
+static void border_pixel(const unsigned char *in, const int x, const int xsize, const int r, uint16_t const *q, uint32_t *acc)
+{
+	int lo = x - r < 0 ? -x : -r;
+	int hi = x + r >= xsize ? xsize - 1 - x : r;
+	uint32_t sr = 0, sg = 0, sb = 0;
+
+	for (int k = lo; k <= hi; ++k)
+	{
+		const unsigned char *p = in + 3 * (x + k);
+		uint32_t qk = q[abs(k)];
+		sr += qk * p[0];
+		sg += qk * p[1];
+		sb += qk * p[2];
+	}
+	acc[3 * x] = sr;
+	acc[3 * x + 1] = sg;
+	acc[3 * x + 2] = sb;
+}
+
+static void hblur_tile(void *arg, int tile, int rank)
+{
+	fixed_args *args = arg;
+	int xsize = args->xsize, r = args->radius;
+	uint16_t const *q = args->q;
+	uint32_t *acc = args->acc + (size_t)rank * 3 * xsize;
+	int end_row = (tile + 1) * args->band < args->ysize ? (tile + 1) * args->band : args->ysize;
+
+	// Pixels whose whole window is inside the row
+	int x0 = r < xsize ? r : xsize;
+	int x1 = xsize - r > x0 ? xsize - r : x0;
+
+	phase_begin(PHASE_HPASS);
+	for (int y = tile * args->band; y < end_row; ++y)
+	{
+		const unsigned char *in = &args->src[(size_t)y * xsize].r;
+		unsigned char *out = &args->dst[(size_t)y * xsize].r;
+
+		// Interior: no bounds, folded symmetric taps
+		if (args->special != NULL)
+			args->special->row(in, acc, 3 * x0, 3 * x1, q);
+		else
+		{
+			for (int i = 3 * x0; i < 3 * x1; ++i)
+				acc[i] = q[0] * in[i];
+			for (int k = 1; k <= r; ++k)
+			{
+				uint32_t qk = q[k];
+				for (int i = 3 * x0; i < 3 * x1; ++i)
+					acc[i] += qk * (in[i - 3 * k] + in[i + 3 * k]);
+			}
+		}
+
+		// Borders: the window is clipped to the row
+		for (int x = 0; x < x0; ++x)
+			border_pixel(in, x, xsize, r, q, acc);
+		for (int x = x1; x < xsize; ++x)
+			border_pixel(in, x, xsize, r, q, acc);
+
+		for (int x = 0; x < xsize; ++x)
+		{
+			uint64_t inv = args->inv_x[x];
+			out[3 * x] = (acc[3 * x] * inv) >> INV_SHIFT;
+			out[3 * x + 1] = (acc[3 * x + 1] * inv) >> INV_SHIFT;
+			out[3 * x + 2] = (acc[3 * x + 2] * inv) >> INV_SHIFT;
+		}
+	}
+	phase_end();
+}
+
+static void vblur_tile(void *arg, int tile, int rank)
+{
+	fixed_args *args = arg;
+	int xsize = args->xsize, ysize = args->ysize, r = args->radius;
+	int n = 3 * xsize;
+	uint16_t const *q = args->q;
+	uint32_t *acc = args->acc + (size_t)rank * n;
+	int end_row = (tile + 1) * args->band < ysize ? (tile + 1) * args->band : ysize;
+
+	phase_begin(PHASE_VPASS);
+	for (int y = tile * args->band; y < end_row; ++y)
+	{
+		int lo = y - r < 0 ? -y : -r;
+		int hi = y + r >= ysize ? ysize - 1 - y : r;
+		unsigned char *out = &args->src[(size_t)y * xsize].r;
+		uint64_t inv = args->inv_y[y];
+
+		if (args->special != NULL && lo == -r && hi == r)
+		{
+			args->special->col(&args->dst[(size_t)y * xsize].r, out, n, n, q, inv);
+			continue;
+		}
+
+		for (int i = 0; i < n; ++i)
+			acc[i] = 0;
+		for (int k = lo; k <= hi; ++k)
+		{
+			const unsigned char *row = &args->dst[(size_t)(y + k) * xsize].r;
+			uint32_t qk = q[abs(k)];
+			for (int i = 0; i < n; ++i)
+				acc[i] += qk * row[i];
+		}
+
+		for (int i = 0; i < n; ++i)
+			out[i] = (acc[i] * inv) >> INV_SHIFT;
+	}
+	phase_end();
+}
+
+void blurfixed(filter_pool *pool, const int xsize, const int ysize, pixel *src, const int radius, const double *w)
+{
+	int num_threads = pool_size(pool);
+	uint16_t *q = malloc(sizeof(uint16_t) * (radius + 1));
+	quantise(radius, w, q);
+
+	fixed_args args;
+	args.xsize = xsize;
+	args.ysize = ysize;
+	args.radius = radius;
+	args.src = src;
+	args.dst = imgbuf_get(sizeof(pixel) * xsize * ysize);
+	args.q = q;
+	args.inv_x = inv_norm(xsize, radius, q);
+	args.inv_y = inv_norm(ysize, radius, q);
+	args.acc = malloc(sizeof(uint32_t) * 3 * xsize * num_threads);
+	args.special = radius <= MAX_SPECIAL_RADIUS && getenv("BLUR_NO_SPECIAL") == NULL ? &special_kernels[radius] : NULL;
+	args.band = ysize / (TILES_PER_WORKER * num_threads);
+	if (args.band < 1)
+		args.band = 1;
+
+	// All rows are blurred horizontally before pool_for returns
+	int tiles = (ysize + args.band - 1) / args.band;
+	pool_for(pool, tiles, hblur_tile, &args);
+	pool_for(pool, tiles, vblur_tile, &args);
+
+	free(args.acc);
+	free((void *)args.inv_y);
+	free((void *)args.inv_x);
+	imgbuf_put(args.dst);
+	free(q);
+}
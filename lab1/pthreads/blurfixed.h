@@ -0,0 +1,17 @@
+/*
+  File: blurfixed.h
+  Declaration of the fixed-point blurfilter.
+ */
+
+#ifndef _BLURFIXED_H_
+#define _BLURFIXED_H_
+
+#include "blurfilter.h"
+
+/* Same interface as blurfilter_pool. The weights are quantised to 16 bits
+   and summed in 32-bit integers; each output is scaled by a precomputed
+   reciprocal of the in-image weight sum instead of dividing. Results stay
+   within one intensity level of blurfilter. */
+void blurfixed(filter_pool *pool, const int xsize, const int ysize, pixel *src, const int radius, const double *w);
+
+#endif
@@ -0,0 +1,136 @@
+/*
+  File: blurgray.c
+  Single-channel blurfilter. Both passes run over bands of whole rows and
+  add the taps one at a time across a row of accumulators, so the inner
+  loops are contiguous and vectorise while each output still sums its
+  taps from -radius up, as blurfilter does.
+ */
+
+#include <stdlib.h>
+#include "blurgray.h"
+#include "../imgbuf.h"
+#include "../phases.h"
+
+typedef struct
+{
+	int xsize, ysize, radius;
+	unsigned char *src, *dst;
+	double const *weights;
+	int band;    // rows per tile
+	double *acc; // xsize accumulators per worker
+	double n;    // sum of all the weights
+} gray_args;
+
+// Pixel x of the row with its window clipped to the row
+static unsigned char border_pixel(const unsigned char *in, const int x, gray_args *args)
+{
+	double v = 0, n = 0;
+	for (int wi = -args->radius; wi <= args->radius; wi++)
+	{
+		double wc = args->weights[abs(wi)];
+		int x2 = x + wi;
+		if (x2 >= 0 && x2 < args->xsize)
+		{
+			v += wc * in[x2];
+			n += wc;
+		}
+	}
+	return v / n;
+}
+
+static void hblur_tile(void *arg, int tile, int rank)
+{
+	gray_args *args = arg;
+	int xsize = args->xsize, r = args->radius;
+	double *acc = args->acc + (size_t)rank * xsize;
+	int end_row = (tile + 1) * args->band < args->ysize ? (tile + 1) * args->band : args->ysize;
+
+	// Pixels [x0, x1) have their whole window inside the row
+	int x0 = r < xsize ? r : xsize;
+	int x1 = xsize - r > x0 ? xsize - r : x0;
+
+	phase_begin(PHASE_HPASS);
+	for (int y = tile * args->band; y < end_row; ++y)
+	{
+		const unsigned char *in = args->src + (size_t)y * xsize;
+		unsigned char *out = args->dst + (size_t)y * xsize;
+
+		for (int x = x0; x < x1; ++x)
+			acc[x] = 0;
+		for (int wi = -r; wi <= r; wi++)
+		{
+			double wc = args->weights[abs(wi)];
+			for (int x = x0; x < x1; ++x)
+				acc[x] += wc * in[x + wi];
+		}
+		for (int x = x0; x < x1; ++x)
+			out[x] = acc[x] / args->n;
+
+		for (int x = 0; x < x0; ++x)
+			out[x] = border_pixel(in, x, args);
+		for (int x = x1; x < xsize; ++x)
+			out[x] = border_pixel(in, x, args);
+	}
+	phase_end();
+}
+
+static void vblur_tile(void *arg, int tile, int rank)
+{
+	gray_args *args = arg;
+	int xsize = args->xsize, ysize = args->ysize;
+	double *acc = args->acc + (size_t)rank * xsize;
+	int end_row = (tile + 1) * args->band < ysize ? (tile + 1) * args->band : ysize;
+
+	phase_begin(PHASE_VPASS);
+	for (int y = tile * args->band; y < end_row; ++y)
+	{
+		unsigned char *out = args->src + (size_t)y * xsize;
+		double n = 0;
+
+		for (int x = 0; x < xsize; ++x)
+			acc[x] = 0;
+		for (int wi = -args->radius; wi <= args->radius; wi++)
+		{
+			double wc = args->weights[abs(wi)];
+			int y2 = y + wi;
+			if (y2 >= 0 && y2 < ysize)
+			{
+				const unsigned char *row = args->dst + (size_t)y2 * xsize;
+				for (int x = 0; x < xsize; ++x)
+					acc[x] += wc * row[x];
+				n += wc;
+			}
+		}
+		for (int x = 0; x < xsize; ++x)
+			out[x] = acc[x] / n;
+	}
+	phase_end();
+}
+
+void blurgray(filter_pool *pool, const int xsize, const int ysize, unsigned char *src, const int radius, const double *w)
+{
+	int num_threads = pool_size(pool);
+
+	gray_args args;
+	args.xsize = xsize;
+	args.ysize = ysize;
+	args.radius = radius;
+	args.src = src;
+	args.dst = imgbuf_get((size_t)xsize * ysize);
+	args.weights = w;
+	args.acc = malloc(sizeof(double) * xsize * num_threads);
+	args.n = 0;
+	for (int wi = -radius; wi <= radius; wi++)
+		args.n += w[abs(wi)];
+	args.band = ysize / (TILES_PER_WORKER * num_threads);
+	if (args.band < 1)
+		args.band = 1;
+
+	// All rows are blurred horizontally before pool_for returns
+	int tiles = (ysize + args.band - 1) / args.band;
+	pool_for(pool, tiles, hblur_tile, &args);
+	pool_for(pool, tiles, vblur_tile, &args);
+
+	free(args.acc);
+	imgbuf_put(args.dst);
+}
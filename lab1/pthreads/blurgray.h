@@ -0,0 +1,17 @@
+/*
+  File: blurgray.h
+  Declaration of the single-channel blurfilter.
+ */
+
+#ifndef _BLURGRAY_H_
+#define _BLURGRAY_H_
+
+#include "pool.h"
+
+/* Blurs the xsize * ysize gray bytes of src in place on the workers of
+   pool. Every output sums its taps in the same order as blurfilter, so a
+   gray image comes out exactly as each channel of its RGB expansion would
+   from blurfilter_pool, with a third of the memory traffic. */
+void blurgray(filter_pool *pool, const int xsize, const int ysize, unsigned char *src, const int radius, const double *w);
+
+#endif
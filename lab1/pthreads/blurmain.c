@@ -2,24 +2,250 @@
 #include <stdio.h>
 #include <string.h>
 #include <time.h>
+#include <unistd.h>
 #include "../ppmio.h"
 #include "blurfilter.h"
+#include "blurstream.h"
+#include "boxblur.h"
+#include "blursimd.h"
+#include "blurfixed.h"
+#include "blurtiled.h"
+#include "numa.h"
+#include "blurgray.h"
+#include "../imgbuf.h"
 #include "../gaussw.h"
-#include <math.h>
+#include "../phases.h"
 
 #define MAX_RAD 1000
 
+enum blur_mode
+{
+	MODE_EXACT,
+	MODE_BOX,
+	MODE_SIMD,
+	MODE_FIXED,
+	MODE_TILED
+};
+
+// Largest and mean absolute difference between two images, per channel value
+static void report_error(const int xsize, const int ysize, const pixel *a, const pixel *b)
+{
+	const unsigned char *pa = (const unsigned char *)a, *pb = (const unsigned char *)b;
+	size_t n = (size_t)xsize * ysize * 3;
+	int max = 0;
+	double sum = 0;
+
+	for (size_t i = 0; i < n; ++i)
+	{
+		int d = abs(pa[i] - pb[i]);
+		if (d > max)
+			max = d;
+		sum += d;
+	}
+	printf("Error against exact kernel: max %d, mean %g\n", max, sum / n);
+}
+
+// Blurs a mapped PGM file, or the luma of a mapped PPM file, into a PGM file
+static int blur_gray(filter_pool *pool, ppm_map *img, const int radius, const double *w, const char *outfile)
+{
+	size_t n = (size_t)img->xsize * img->ysize;
+	unsigned char *gray = (unsigned char *)img->data;
+	struct timespec stime, etime;
+
+	if (img->channels == 3)
+	{
+		phase_begin(PHASE_READ);
+		gray = imgbuf_get(n);
+		rgb_to_luma(img->data, (char *)gray, n);
+		phase_end();
+	}
+
+	printf("Calling filter\n");
+
+	clock_gettime(CLOCK_REALTIME, &stime);
+	blurgray(pool, img->xsize, img->ysize, gray, radius, w);
+	clock_gettime(CLOCK_REALTIME, &etime);
+
+	printf("Filtering took: %g secs\n", (etime.tv_sec - stime.tv_sec) +
+											1e-9 * (etime.tv_nsec - stime.tv_nsec));
+
+	/* Write result */
+	printf("Writing output file\n");
+
+	phase_begin(PHASE_WRITE);
+	int ret = write_pnm(outfile, img->xsize, img->ysize, 1, (char *)gray);
+	phase_end();
+	if (gray != (unsigned char *)img->data)
+		imgbuf_put(gray);
+	return ret;
+}
+
+// Blurs one image file into another on the workers of pool
+static int blur_image(filter_pool *pool, enum blur_mode mode, int check, int numa, int luma, const int radius, const double *w, const char *infile, const char *outfile)
+{
+	int xsize, ysize, colmax;
+	ppm_map img;
+	pixel *src;
+	struct timespec stime, etime;
+
+	/* Map file */
+	phase_begin(PHASE_READ);
+	int mapped = map_ppm(infile, &img);
+	phase_end();
+	if (mapped != 0)
+		return 1;
+	xsize = img.xsize;
+	ysize = img.ysize;
+	colmax = img.max;
+	src = (pixel *)img.data;
+
+	if (colmax > 255)
+	{
+		fprintf(stderr, "Too large maximum color-component value\n");
+		unmap_ppm(&img);
+		return 1;
+	}
+
+	// Gray images take the single-channel exact kernel only
+	if (img.channels == 1 || luma)
+	{
+		int ret = 1;
+		if (mode != MODE_EXACT || check || numa)
+			fprintf(stderr, "%s: gray images only have the exact blur, without -e or -N\n", infile);
+		else
+			ret = blur_gray(pool, &img, radius, w, outfile);
+		unmap_ppm(&img);
+		return ret;
+	}
+
+	// Work on a copy spread over the nodes of the workers
+	if (numa)
+	{
+		src = numa_place(pool, xsize, ysize, src);
+		if (src == NULL)
+		{
+			unmap_ppm(&img);
+			return 1;
+		}
+		numa_report(pool, xsize, ysize, src);
+	}
+
+	printf("Calling filter\n");
+
+	pixel *exact = NULL;
+	if (check && mode != MODE_EXACT)
+	{
+		exact = malloc(sizeof(pixel) * xsize * ysize);
+		memcpy(exact, src, sizeof(pixel) * xsize * ysize);
+	}
+
+	clock_gettime(CLOCK_REALTIME, &stime);
+	switch (mode)
+	{
+	case MODE_EXACT:
+		blurfilter_pool(pool, xsize, ysize, src, radius, w);
+		break;
+	case MODE_BOX:
+		boxblur(pool, xsize, ysize, src, radius);
+		break;
+	case MODE_SIMD:
+		printf("Using %s kernel\n", blursimd_isa());
+		blursimd(pool, xsize, ysize, src, radius, w);
+		break;
+	case MODE_FIXED:
+		blurfixed(pool, xsize, ysize, src, radius, w);
+		break;
+	case MODE_TILED:
+		blurtiled(pool, xsize, ysize, src, radius, w);
+		break;
+	}
+	clock_gettime(CLOCK_REALTIME, &etime);
+
+	printf("Filtering took: %g secs\n", (etime.tv_sec - stime.tv_sec) +
+											1e-9 * (etime.tv_nsec - stime.tv_nsec));
+
+	if (exact != NULL)
+	{
+		blurfilter_pool(pool, xsize, ysize, exact, radius, w);
+		report_error(xsize, ysize, src, exact);
+		free(exact);
+	}
+
+	/* Write result */
+	printf("Writing output file\n");
+
+	phase_begin(PHASE_WRITE);
+	int ret = write_ppm(outfile, xsize, ysize, (char *)src);
+	phase_end();
+	if (numa)
+		numa_free(src, xsize, ysize);
+	unmap_ppm(&img);
+	return ret;
+}
+
 int main(int argc, char **argv)
 {
-	int radius, xsize, ysize, colmax;
-	pixel *src = (pixel *)malloc(sizeof(pixel) * MAX_PIXELS);
+	int radius;
 	struct timespec stime, etime;
-	double w[MAX_RAD];
+	double w[MAX_RAD + 1];
+	int band = 0, check = 0, numa = 0, luma = 0;
+	enum blur_mode mode = MODE_EXACT;
+
+	phases_init(argv[0], 0);
 
 	/* Take care of the arguments */
-	if (argc != 5)
+	int opt;
+	while ((opt = getopt(argc, argv, "s:m:eNg")) != -1)
 	{
-		fprintf(stderr, "Usage: %s radius threads infile outfile\n", argv[0]);
+		switch (opt)
+		{
+		case 's':
+			band = atoi(optarg);
+			if (band < 1)
+			{
+				fprintf(stderr, "Band (%d) must be greater than zero\n", band);
+				exit(1);
+			}
+			break;
+		case 'm':
+			if (strcmp(optarg, "exact") == 0)
+				mode = MODE_EXACT;
+			else if (strcmp(optarg, "box") == 0)
+				mode = MODE_BOX;
+			else if (strcmp(optarg, "simd") == 0)
+				mode = MODE_SIMD;
+			else if (strcmp(optarg, "fixed") == 0)
+				mode = MODE_FIXED;
+			else if (strcmp(optarg, "tiled") == 0)
+				mode = MODE_TILED;
+			else
+			{
+				fprintf(stderr, "Unknown mode %s\n", optarg);
+				exit(1);
+			}
+			break;
+		case 'e':
+			check = 1;
+			break;
+		case 'N':
+			numa = 1;
+			break;
+		case 'g':
+			luma = 1;
+			break;
+		default:
+			argc = 0;
+		}
+	}
+	// Drop the options, keeping the program name in argv[0]
+	argv[optind - 1] = argv[0];
+	argc -= optind - 1;
+	argv += optind - 1;
+
+	if (argc < 5 || argc % 2 == 0)
+	{
+		fprintf(stderr, "Usage: %s [-m exact|box|simd|fixed|tiled] [-e] [-N] [-g] [-s band_rows] radius threads infile outfile [infile outfile ...]\n", argv[0]);
+		fprintf(stderr, "  -g: blur the luma of PPM input into PGM output, PGM (P5) input is always blurred as gray\n");
 		exit(1);
 	}
 
@@ -31,40 +257,42 @@ int main(int argc, char **argv)
 	}
 
 	int threads = atoi(argv[2]);
-	int exponent = log2f(threads);
-	if ((threads > 64 || threads < 1 || exponent != ceil(exponent)))
+	if (threads < 1)
 	{
-		fprintf(stderr, "Threads (%d) must be an element of the 2^n series and <= 64", threads);
+		fprintf(stderr, "Threads (%d) must be greater than zero\n", threads);
 		exit(1);
 	}
 
-	/* Read file */
-	if (read_ppm(argv[3], &xsize, &ysize, &colmax, (char *)src) != 0)
-		exit(1);
-
-	if (colmax > 255)
+	if (band > 0 && (mode != MODE_EXACT || check || numa || luma))
 	{
-		fprintf(stderr, "Too large maximum color-component value\n");
+		fprintf(stderr, "Streaming (-s) only has the exact RGB blur, without -m, -e, -N or -g\n");
 		exit(1);
 	}
 
-	printf("Has read the image, generating coefficients\n");
+	/* One set of workers and weights for all the images */
+	filter_pool *pool = pool_create(threads, 1);
 
-	/* filter */
+	printf("Generating coefficients\n");
+	phase_begin(PHASE_WEIGHTS);
 	get_gauss_weights(radius, w);
+	phase_end();
 
-	printf("Calling filter\n");
-
-	clock_gettime(CLOCK_REALTIME, &stime);
-	blurfilter(xsize, ysize, src, radius, w, threads);
-	clock_gettime(CLOCK_REALTIME, &etime);
-
-	printf("Filtering took: %g secs\n", (etime.tv_sec - stime.tv_sec) +
-											1e-9 * (etime.tv_nsec - stime.tv_nsec));
+	for (int f = 3; f < argc; f += 2)
+	{
+		if (band > 0)
+		{
+			/* Stream the image through band rows at a time */
+			clock_gettime(CLOCK_REALTIME, &stime);
+			if (blurstream(pool, argv[f], argv[f + 1], radius, w, band) != 0)
+				exit(1);
+			clock_gettime(CLOCK_REALTIME, &etime);
 
-	/* Write result */
-	printf("Writing output file\n");
+			printf("Streaming blur took: %g secs\n", (etime.tv_sec - stime.tv_sec) +
+														   1e-9 * (etime.tv_nsec - stime.tv_nsec));
+		}
+		else if (blur_image(pool, mode, check, numa, luma, radius, w, argv[f], argv[f + 1]) != 0)
+			exit(1);
+	}
 
-	if (write_ppm(argv[4], xsize, ysize, (char *)src) != 0)
-		exit(1);
+	pool_destroy(pool);
 }
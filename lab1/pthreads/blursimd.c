@@ -0,0 +1,224 @@
+/*
+  File: blursimd.c
+  Vectorised blurfilter. Pixels are split into planar float channels, the
+  borders are padded with zeros and both passes become the same branch-free
+  multiply-add over taps, run with AVX2 when the CPU has it.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "blursimd.h"
+#include "../imgbuf.h"
+#include "../phases.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86 1
+#endif
+
+// out[x] = sum_k wk[k] * src[k][x] for x in [0, n)
+typedef void (*taps_fn)(const float *const *src, float *out, const int n, const float *wk, const int taps);
+
+typedef struct
+{
+	int xsize, ysize, radius;
+	pixel *src;
+	float *plane[3];           // horizontally blurred channels
+	float const *wk;           // 2 * radius + 1 taps
+	float const *inv_nx, *inv_ny; // reciprocal of the in-image weight sum
+	float const *zero;         // xsize zeros standing in for rows off the image
+	taps_fn kernel;
+	filter_pool *pool;
+} simd_args;
+
+static void taps_scalar(const float *const *src, float *out, const int n, const float *wk, const int taps)
+{
+	// Tap-outer order keeps the inner loop a plain axpy the compiler can
+	// vectorise with whatever the baseline ISA offers
+	memset(out, 0, sizeof(float) * n);
+	for (int k = 0; k < taps; ++k)
+	{
+		const float *s = src[k];
+		const float wc = wk[k];
+		for (int x = 0; x < n; ++x)
+			out[x] += wc * s[x];
+	}
+}
+
+#ifdef HAVE_X86
+__attribute__((target("avx2,fma"))) static void taps_avx2(const float *const *src, float *out, const int n, const float *wk, const int taps)
+{
+	int x = 0;
+
+	// 32 outputs held in registers across all taps
+	for (; x + 32 <= n; x += 32)
+	{
+		__m256 a0 = _mm256_setzero_ps(), a1 = a0, a2 = a0, a3 = a0;
+		for (int k = 0; k < taps; ++k)
+		{
+			__m256 w = _mm256_broadcast_ss(wk + k);
+			const float *s = src[k] + x;
+			a0 = _mm256_fmadd_ps(w, _mm256_loadu_ps(s), a0);
+			a1 = _mm256_fmadd_ps(w, _mm256_loadu_ps(s + 8), a1);
+			a2 = _mm256_fmadd_ps(w, _mm256_loadu_ps(s + 16), a2);
+			a3 = _mm256_fmadd_ps(w, _mm256_loadu_ps(s + 24), a3);
+		}
+		_mm256_storeu_ps(out + x, a0);
+		_mm256_storeu_ps(out + x + 8, a1);
+		_mm256_storeu_ps(out + x + 16, a2);
+		_mm256_storeu_ps(out + x + 24, a3);
+	}
+	for (; x + 8 <= n; x += 8)
+	{
+		__m256 a = _mm256_setzero_ps();
+		for (int k = 0; k < taps; ++k)
+			a = _mm256_fmadd_ps(_mm256_broadcast_ss(wk + k), _mm256_loadu_ps(src[k] + x), a);
+		_mm256_storeu_ps(out + x, a);
+	}
+	for (; x < n; ++x)
+	{
+		float acc = 0;
+		for (int k = 0; k < taps; ++k)
+			acc += wk[k] * src[k][x];
+		out[x] = acc;
+	}
+}
+#endif
+
+static taps_fn select_kernel(void)
+{
+	if (getenv("BLUR_NO_SIMD") != NULL)
+		return taps_scalar;
+#ifdef HAVE_X86
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+		return taps_avx2;
+#endif
+	return taps_scalar;
+}
+
+const char *blursimd_isa(void)
+{
+	return select_kernel() == taps_scalar ? "scalar" : "avx2";
+}
+
+static void work(void *arg, int rank, int num_threads)
+{
+	simd_args args = *(simd_args *)arg;
+	int xsize = args.xsize, ysize = args.ysize, r = args.radius;
+	int taps = 2 * r + 1;
+
+	// Zero-padded input line per channel, output line and tap pointers
+	float *line = calloc(3 * (xsize + 2 * r), sizeof(float));
+	float *out = malloc(sizeof(float) * xsize);
+	const float **rows = malloc(sizeof(float *) * taps);
+
+	int thread_rows = ysize / num_threads;
+	int start_row = rank * thread_rows;
+	int end_row = start_row + thread_rows;
+
+	// Last thread does the remaining work
+	if (rank == num_threads - 1)
+		end_row += ysize % num_threads;
+
+	phase_begin(PHASE_HPASS);
+	for (int y = start_row; y < end_row; ++y)
+	{
+		pixel *p = args.src + (size_t)y * xsize;
+		for (int x = 0; x < xsize; ++x)
+		{
+			line[r + x] = p[x].r;
+			line[(xsize + 2 * r) + r + x] = p[x].g;
+			line[2 * (xsize + 2 * r) + r + x] = p[x].b;
+		}
+		for (int c = 0; c < 3; ++c)
+		{
+			float *h = args.plane[c] + (size_t)y * xsize;
+			for (int k = 0; k < taps; ++k)
+				rows[k] = line + c * (xsize + 2 * r) + k;
+			args.kernel(rows, h, xsize, args.wk, taps);
+			for (int x = 0; x < xsize; ++x)
+				h[x] *= args.inv_nx[x];
+		}
+	}
+
+	phase_end();
+
+	// Wait for all the rows to be blurred
+	pool_barrier(args.pool);
+
+	// Rows are contiguous in the planes, so the vertical pass is split by
+	// rows as well and vectorised along x.
+	phase_begin(PHASE_VPASS);
+	for (int y = start_row; y < end_row; ++y)
+	{
+		pixel *p = args.src + (size_t)y * xsize;
+		for (int c = 0; c < 3; ++c)
+		{
+			for (int k = 0; k < taps; ++k)
+			{
+				int y2 = y + k - r;
+				rows[k] = (y2 >= 0 && y2 < ysize) ? args.plane[c] + (size_t)y2 * xsize : args.zero;
+			}
+			args.kernel(rows, out, xsize, args.wk, taps);
+
+			unsigned char *ch = &p->r + c;
+			for (int x = 0; x < xsize; ++x)
+				ch[3 * x] = out[x] * args.inv_ny[y];
+		}
+	}
+	phase_end();
+
+	free(rows);
+	free(out);
+	free(line);
+}
+
+// Reciprocal of the sum of the weights that fall inside [0, len)
+static float *inv_norm(const int len, const int radius, const double *w)
+{
+	float *inv = malloc(sizeof(float) * len);
+	for (int i = 0; i < len; ++i)
+	{
+		double n = 0;
+		for (int wi = -radius; wi <= radius; ++wi)
+			if (i + wi >= 0 && i + wi < len)
+				n += w[abs(wi)];
+		inv[i] = 1.0 / n;
+	}
+	return inv;
+}
+
+void blursimd(filter_pool *pool, const int xsize, const int ysize, pixel *src, const int radius, const double *w)
+{
+	int taps = 2 * radius + 1;
+	float *wk = malloc(sizeof(float) * taps);
+	for (int k = 0; k < taps; ++k)
+		wk[k] = w[abs(k - radius)];
+
+	float *inv_nx = inv_norm(xsize, radius, w);
+	float *inv_ny = inv_norm(ysize, radius, w);
+	float *zero = calloc(xsize, sizeof(float));
+	float *planes = imgbuf_get(sizeof(float) * 3 * xsize * ysize);
+
+	simd_args args;
+	args.xsize = xsize;
+	args.ysize = ysize;
+	args.radius = radius;
+	args.src = src;
+	for (int c = 0; c < 3; ++c)
+		args.plane[c] = planes + (size_t)c * xsize * ysize;
+	args.wk = wk;
+	args.inv_nx = inv_nx;
+	args.inv_ny = inv_ny;
+	args.zero = zero;
+	args.kernel = select_kernel();
+	args.pool = pool;
+
+	pool_run(pool, work, &args);
+
+	imgbuf_put(planes);
+	free(zero);
+	free(inv_ny);
+	free(inv_nx);
+	free(wk);
+}
@@ -0,0 +1,21 @@
+/*
+  File: blursimd.h
+  Declaration of the vectorised blurfilter.
+ */
+
+#ifndef _BLURSIMD_H_
+#define _BLURSIMD_H_
+
+#include "blurfilter.h"
+
+/* Same interface as blurfilter_pool. Works on planar float channels with
+   zero-padded borders; uses AVX2 when available and a scalar loop
+   otherwise (or when BLUR_NO_SIMD is set in the environment). The
+   intermediate is kept in float rather than truncated to bytes, so results
+   differ from blurfilter by at most a couple of intensity levels. */
+void blursimd(filter_pool *pool, const int xsize, const int ysize, pixel *src, const int radius, const double *w);
+
+/* Name of the kernel blursimd dispatches to on this machine. */
+const char *blursimd_isa(void);
+
+#endif
@@ -0,0 +1,79 @@
+/*
+  File: blurspecial.c
+  Blur kernels generated for every radius up to MAX_SPECIAL_RADIUS. With
+  the tap count known the compiler unrolls the taps completely, keeps the
+  sums in registers and drops the bounds checks, which the callers make
+  unnecessary by only passing pixels whose window is inside the image.
+ */
+
+#include <stdlib.h>
+#include "blurspecial.h"
+
+// Taps are summed from -R to R like the generic loops, not folded around
+// the centre: in double that would change the rounding of the sums.
+#define ROW_KERNEL(R) \
+	static void row_kernel_##R(const pixel *in, pixel *out, const int x0, const int x1, const double *w, const double n) \
+	{ \
+		double wk[2 * R + 1]; \
+		for (int k = 0; k <= 2 * R; ++k) \
+			wk[k] = w[abs(k - R)]; \
+		for (int x = x0; x < x1; ++x) \
+		{ \
+			const pixel *p = in + x - R; \
+			double r = 0, g = 0, b = 0; \
+			_Pragma("GCC unroll 65") for (int k = 0; k <= 2 * R; ++k) \
+			{ \
+				r += wk[k] * p[k].r; \
+				g += wk[k] * p[k].g; \
+				b += wk[k] * p[k].b; \
+			} \
+			out[x].r = r / n; \
+			out[x].g = g / n; \
+			out[x].b = b / n; \
+		} \
+	}
+
+#define COL_KERNEL(R) \
+	static void col_kernel_##R(const pixel *in, pixel *out, const int xsize, const int width, const double *w, const double n) \
+	{ \
+		double wk[2 * R + 1]; \
+		for (int k = 0; k <= 2 * R; ++k) \
+			wk[k] = w[abs(k - R)]; \
+		for (int i = 0; i < width; ++i) \
+		{ \
+			const pixel *p = in + i; \
+			double r = 0, g = 0, b = 0; \
+			_Pragma("GCC unroll 65") for (int k = 0; k <= 2 * R; ++k) \
+			{ \
+				r += wk[k] * p[(size_t)k * xsize].r; \
+				g += wk[k] * p[(size_t)k * xsize].g; \
+				b += wk[k] * p[(size_t)k * xsize].b; \
+			} \
+			out[i].r = r / n; \
+			out[i].g = g / n; \
+			out[i].b = b / n; \
+		} \
+	}
+
+SPECIAL_RADII(ROW_KERNEL)
+SPECIAL_RADII(COL_KERNEL)
+
+#define ROW_ENTRY(R) [R] = row_kernel_##R,
+#define COL_ENTRY(R) [R] = col_kernel_##R,
+
+static const row_kernel row_kernels[MAX_SPECIAL_RADIUS + 1] = {SPECIAL_RADII(ROW_ENTRY)};
+static const col_kernel col_kernels[MAX_SPECIAL_RADIUS + 1] = {SPECIAL_RADII(COL_ENTRY)};
+
+row_kernel special_row_kernel(const int radius)
+{
+	if (radius < 1 || radius > MAX_SPECIAL_RADIUS || getenv("BLUR_NO_SPECIAL") != NULL)
+		return NULL;
+	return row_kernels[radius];
+}
+
+col_kernel special_col_kernel(const int radius)
+{
+	if (radius < 1 || radius > MAX_SPECIAL_RADIUS || getenv("BLUR_NO_SPECIAL") != NULL)
+		return NULL;
+	return col_kernels[radius];
+}
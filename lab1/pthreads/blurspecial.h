@@ -0,0 +1,37 @@
+/*
+  File: blurspecial.h
+  Declaration of the blur kernels specialised for small radii.
+ */
+
+#ifndef _BLURSPECIAL_H_
+#define _BLURSPECIAL_H_
+
+#include "pixel.h"
+
+/* Largest radius with specialised kernels */
+#define MAX_SPECIAL_RADIUS 32
+
+/* Applies X to every specialised radius, to generate kernels and tables */
+#define SPECIAL_RADII(X) \
+	X(1) X(2) X(3) X(4) X(5) X(6) X(7) X(8) \
+	X(9) X(10) X(11) X(12) X(13) X(14) X(15) X(16) \
+	X(17) X(18) X(19) X(20) X(21) X(22) X(23) X(24) \
+	X(25) X(26) X(27) X(28) X(29) X(30) X(31) X(32)
+
+/* Horizontal pass over the pixels [x0, x1) of one row, whose windows must
+   lie inside the row. n is the sum of all 2 * radius + 1 weights. */
+typedef void (*row_kernel)(const pixel *in, pixel *out, const int x0, const int x1, const double *w, const double n);
+
+/* Vertical pass for width pixels of one output row. in points at the
+   first pixel of the row radius rows above it, which must exist, as must
+   the row radius rows below it. */
+typedef void (*col_kernel)(const pixel *in, pixel *out, const int xsize, const int width, const double *w, const double n);
+
+/* Kernels with radius fixed at compile time and the taps unrolled. They
+   sum the taps in the same order as blurfilter's generic loops, so the
+   output is bit-identical. NULL when radius has none, or when
+   BLUR_NO_SPECIAL is set in the environment. */
+row_kernel special_row_kernel(const int radius);
+col_kernel special_col_kernel(const int radius);
+
+#endif
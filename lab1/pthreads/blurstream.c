@@ -0,0 +1,277 @@
+/*
+  File: blurstream.c
+  Streaming blurfilter: the image is read, blurred and written in horizontal
+  bands so only a few bands of rows are ever held in memory.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "blurstream.h"
+#include "../ppmio.h"
+#include "../phases.h"
+
+// Raw input bands handed from the reader thread to the compute loop
+#define RAW_SLOTS 2
+
+typedef struct
+{
+	FILE *fp;
+	int xsize, ysize, band;
+	pixel *slot[RAW_SLOTS];
+	int rows[RAW_SLOTS]; // rows in the slot, 0 when empty, -1 on read error
+	int next_fill, next_take;
+	int stop; // set by the consumer to abandon the read-ahead
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+} band_reader;
+
+typedef struct
+{
+	int xsize, ysize, radius, ring;
+	double const *weights;
+	pixel *raw, *hbuf, *out;
+	int first, count; // rows of the current step
+} band_args;
+
+static void *read_bands(void *arg)
+{
+	band_reader *rd = arg;
+
+	phases_thread_start("reader", 0);
+	for (int y = 0; y < rd->ysize; y += rd->band)
+	{
+		int s = rd->next_fill;
+		int rows = rd->ysize - y < rd->band ? rd->ysize - y : rd->band;
+
+		pthread_mutex_lock(&rd->lock);
+		while (rd->rows[s] != 0 && !rd->stop)
+			pthread_cond_wait(&rd->cond, &rd->lock);
+		pthread_mutex_unlock(&rd->lock);
+		if (rd->stop)
+			break;
+
+		size_t len = (size_t)rows * rd->xsize * 3;
+		phase_begin(PHASE_READ);
+		if (fread(rd->slot[s], 1, len, rd->fp) != len)
+		{
+			perror("Read failed");
+			rows = -1;
+		}
+		phase_end();
+
+		pthread_mutex_lock(&rd->lock);
+		rd->rows[s] = rows;
+		rd->next_fill = (s + 1) % RAW_SLOTS;
+		pthread_cond_broadcast(&rd->cond);
+		pthread_mutex_unlock(&rd->lock);
+
+		if (rows < 0)
+			break;
+	}
+	phases_thread_end();
+	return NULL;
+}
+
+// Row y of the horizontally blurred ring buffer
+static pixel *ring_row(band_args *args, int y)
+{
+	return args->hbuf + (size_t)(y % args->ring) * args->xsize;
+}
+
+// Horizontal pass over the rows [first, first + count) of the raw band
+static void hblur_rows(void *arg, int rank, int num_threads)
+{
+	band_args *args = arg;
+	phase_begin(PHASE_HPASS);
+	for (int i = rank; i < args->count; i += num_threads)
+	{
+		pixel *src = args->raw + (size_t)i * args->xsize;
+		pixel *dst = ring_row(args, args->first + i);
+		for (int x = 0; x < args->xsize; ++x)
+		{
+			double r = 0, g = 0, b = 0, n = 0;
+			for (int wi = -args->radius; wi <= args->radius; wi++)
+			{
+				double wc = args->weights[abs(wi)];
+				int x2 = x + wi;
+				if (x2 >= 0 && x2 < args->xsize)
+				{
+					r += wc * src[x2].r;
+					g += wc * src[x2].g;
+					b += wc * src[x2].b;
+					n += wc;
+				}
+			}
+			dst[x].r = r / n;
+			dst[x].g = g / n;
+			dst[x].b = b / n;
+		}
+	}
+	phase_end();
+}
+
+// Vertical pass producing the output rows [first, first + count)
+static void vblur_rows(void *arg, int rank, int num_threads)
+{
+	band_args *args = arg;
+	phase_begin(PHASE_VPASS);
+	for (int i = rank; i < args->count; i += num_threads)
+	{
+		int y = args->first + i;
+		pixel *dst = args->out + (size_t)i * args->xsize;
+		for (int x = 0; x < args->xsize; ++x)
+		{
+			double r = 0, g = 0, b = 0, n = 0;
+			for (int wi = -args->radius; wi <= args->radius; wi++)
+			{
+				double wc = args->weights[abs(wi)];
+				int y2 = y + wi;
+				if (y2 >= 0 && y2 < args->ysize)
+				{
+					pixel *p = ring_row(args, y2) + x;
+					r += wc * p->r;
+					g += wc * p->g;
+					b += wc * p->b;
+					n += wc;
+				}
+			}
+			dst[x].r = r / n;
+			dst[x].g = g / n;
+			dst[x].b = b / n;
+		}
+	}
+	phase_end();
+}
+
+int blurstream(filter_pool *pool, const char *infile, const char *outfile, const int radius, const double *w, const int band)
+{
+	int xsize, ysize, colmax, channels, ret = 0;
+	band_reader rd = {0};
+	band_args proto = {0};
+
+	rd.fp = fopen(infile, "r");
+	if (rd.fp == NULL)
+	{
+		perror("blurstream failed to open input");
+		return 1;
+	}
+	if (read_pnm_header(rd.fp, &xsize, &ysize, &colmax, &channels) != 0)
+	{
+		fclose(rd.fp);
+		return 4;
+	}
+	if (channels != 3)
+	{
+		fprintf(stderr, "%s: the streaming blur only takes PPM (P6) input\n", infile);
+		fclose(rd.fp);
+		return 4;
+	}
+	if (colmax > 255)
+	{
+		fprintf(stderr, "Too large maximum color-component value\n");
+		fclose(rd.fp);
+		return 4;
+	}
+
+	FILE *out = fopen(outfile, "w");
+	if (out == NULL)
+	{
+		perror("blurstream failed to open output");
+		fclose(rd.fp);
+		return 1;
+	}
+	write_ppm_header(out, xsize, ysize);
+
+	rd.xsize = xsize;
+	rd.ysize = ysize;
+	rd.band = band;
+	pthread_mutex_init(&rd.lock, NULL);
+	pthread_cond_init(&rd.cond, NULL);
+	for (int s = 0; s < RAW_SLOTS; ++s)
+		rd.slot[s] = malloc(sizeof(pixel) * xsize * band);
+
+	// A step consumes whole raw bands, so the ring may run up to one band
+	// ahead of the radius-deep context below the output band.
+	proto.xsize = xsize;
+	proto.ysize = ysize;
+	proto.radius = radius;
+	proto.weights = w;
+	proto.ring = 2 * (band + radius);
+	proto.hbuf = malloc(sizeof(pixel) * xsize * proto.ring);
+	proto.out = malloc(sizeof(pixel) * xsize * band);
+
+	pthread_t reader;
+	pthread_create(&reader, NULL, read_bands, &rd);
+
+	int hdone = 0;
+	for (int y0 = 0; y0 < ysize && ret == 0; y0 += band)
+	{
+		int y1 = y0 + band < ysize ? y0 + band : ysize;
+		int need = y1 + radius < ysize ? y1 + radius : ysize;
+
+		// Horizontally blur raw bands until the output band has its context
+		while (hdone < need)
+		{
+			int s = rd.next_take;
+			pthread_mutex_lock(&rd.lock);
+			while (rd.rows[s] == 0)
+				pthread_cond_wait(&rd.cond, &rd.lock);
+			pthread_mutex_unlock(&rd.lock);
+
+			if (rd.rows[s] < 0)
+			{
+				ret = 2;
+				break;
+			}
+
+			proto.raw = rd.slot[s];
+			proto.first = hdone;
+			proto.count = rd.rows[s];
+			pool_run(pool, hblur_rows, &proto);
+			hdone += rd.rows[s];
+
+			pthread_mutex_lock(&rd.lock);
+			rd.rows[s] = 0;
+			rd.next_take = (s + 1) % RAW_SLOTS;
+			pthread_cond_broadcast(&rd.cond);
+			pthread_mutex_unlock(&rd.lock);
+		}
+		if (ret != 0)
+			break;
+
+		proto.first = y0;
+		proto.count = y1 - y0;
+		pool_run(pool, vblur_rows, &proto);
+
+		size_t len = (size_t)(y1 - y0) * xsize * 3;
+		phase_begin(PHASE_WRITE);
+		if (fwrite(proto.out, 1, len, out) != len)
+		{
+			perror("Write failed");
+			ret = 2;
+		}
+		phase_end();
+	}
+
+	pthread_mutex_lock(&rd.lock);
+	rd.stop = 1;
+	pthread_cond_broadcast(&rd.cond);
+	pthread_mutex_unlock(&rd.lock);
+	pthread_join(reader, NULL);
+
+	if (fclose(out) == EOF && ret == 0)
+	{
+		perror("Close failed");
+		ret = 3;
+	}
+	fclose(rd.fp);
+
+	for (int s = 0; s < RAW_SLOTS; ++s)
+		free(rd.slot[s]);
+	free(proto.hbuf);
+	free(proto.out);
+	pthread_mutex_destroy(&rd.lock);
+	pthread_cond_destroy(&rd.cond);
+	return ret;
+}
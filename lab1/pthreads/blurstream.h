@@ -0,0 +1,18 @@
+/*
+  File: blurstream.h
+  Declaration of the streaming (row-band) blurfilter.
+ */
+
+#ifndef _BLURSTREAM_H_
+#define _BLURSTREAM_H_
+
+#include "blurfilter.h"
+
+/* Blurs the PPM (P6) infile into outfile reading, filtering and writing
+   band rows at a time. Input is read ahead by a separate thread while a
+   band is computed on the workers of pool.
+   Peak memory is O(xsize * (band + radius)) instead of the whole image.
+   Returns 0 on success. */
+int blurstream(filter_pool *pool, const char *infile, const char *outfile, const int radius, const double *w, const int band);
+
+#endif
@@ -0,0 +1,199 @@
+/*
+  File: blurtiled.c
+  Tiled blurfilter. The arithmetic matches blurfilter's loops (and uses
+  the same specialised kernels) so the results are identical; only the
+  order in which pixels are visited and where the intermediate lives
+  differ.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "blurtiled.h"
+#include "blurspecial.h"
+#include "../imgbuf.h"
+#include "../phases.h"
+
+// Cache budget for the scratch rows of one tile
+#define TILE_CACHE_BYTES (256 * 1024)
+#define TILE_ROWS 256
+#define MIN_TILE 16
+
+typedef struct
+{
+	int xsize, ysize, radius;
+	pixel *src;
+	double const *weights;
+	double n;       // sum of all the weights
+	row_kernel row; // specialised kernels for the radius, or NULL
+	col_kernel col;
+	int band, width; // rows per band, columns per tile
+	pixel *ring;     // ring_rows output rows, row y in slot y % ring_rows
+	int ring_rows;
+	pixel *scratch; // (band + 2 * radius) * width per worker
+	int y0, y1;     // rows of the current band
+	int done;       // rows [0, done) are back in src
+	int upto;       // rows to put back by write_back
+} tiled_args;
+
+static pixel *ring_row(tiled_args *args, int y)
+{
+	return args->ring + (size_t)(y % args->ring_rows) * args->xsize;
+}
+
+// Horizontal blur of pixel x of row in, clipped to the row
+static void hblur_pixel(const pixel *in, pixel *out, int x, tiled_args *args)
+{
+	double r = 0, g = 0, b = 0, n = 0;
+	for (int wi = -args->radius; wi <= args->radius; wi++)
+	{
+		double wc = args->weights[abs(wi)];
+		int x2 = x + wi;
+		if (x2 >= 0 && x2 < args->xsize)
+		{
+			r += wc * in[x2].r;
+			g += wc * in[x2].g;
+			b += wc * in[x2].b;
+			n += wc;
+		}
+	}
+	out->r = r / n;
+	out->g = g / n;
+	out->b = b / n;
+}
+
+// Vertical blur of column i of the scratch rows for output row y, clipped
+// to the image. h0 is the image row held in the first scratch row.
+static void vblur_pixel(const pixel *scratch, pixel *out, int i, int y, int h0, int width, tiled_args *args)
+{
+	double r = 0, g = 0, b = 0, n = 0;
+	for (int wi = -args->radius; wi <= args->radius; wi++)
+	{
+		double wc = args->weights[abs(wi)];
+		int y2 = y + wi;
+		if (y2 >= 0 && y2 < args->ysize)
+		{
+			const pixel *p = scratch + (size_t)(y2 - h0) * width + i;
+			r += wc * p->r;
+			g += wc * p->g;
+			b += wc * p->b;
+			n += wc;
+		}
+	}
+	out->r = r / n;
+	out->g = g / n;
+	out->b = b / n;
+}
+
+// Blurs the columns [x0, x1) of the current band into the ring
+static void band_tile(void *arg, int tile, int rank)
+{
+	tiled_args *args = arg;
+	int r = args->radius;
+	int x0 = tile * args->width;
+	int x1 = x0 + args->width < args->xsize ? x0 + args->width : args->xsize;
+	int width = x1 - x0;
+	pixel *scratch = args->scratch + (size_t)rank * (args->band + 2 * r) * args->width;
+
+	// Columns whose window is inside the row go to the row kernel
+	int k0 = x0 > r ? x0 : r;
+	int k1 = x1 < args->xsize - r ? x1 : args->xsize - r;
+	if (args->row == NULL || k0 >= k1)
+		k0 = k1 = x0;
+
+	// Horizontal pass over the band and its halo rows
+	int h0 = args->y0 - r > 0 ? args->y0 - r : 0;
+	int h1 = args->y1 + r < args->ysize ? args->y1 + r : args->ysize;
+	phase_begin(PHASE_HPASS);
+	for (int y = h0; y < h1; ++y)
+	{
+		const pixel *in = args->src + (size_t)y * args->xsize;
+		pixel *out = scratch + (size_t)(y - h0) * width;
+
+		for (int x = x0; x < k0; ++x)
+			hblur_pixel(in, out + x - x0, x, args);
+		if (k0 < k1)
+			args->row(in + k0, out + k0 - x0, 0, k1 - k0, args->weights, args->n);
+		for (int x = k1; x < x1; ++x)
+			hblur_pixel(in, out + x - x0, x, args);
+	}
+	phase_end();
+
+	// Vertical pass straight from the scratch rows
+	phase_begin(PHASE_VPASS);
+	for (int y = args->y0; y < args->y1; ++y)
+	{
+		pixel *out = ring_row(args, y) + x0;
+		if (args->col != NULL && y - r >= 0 && y + r < args->ysize)
+			args->col(scratch + (size_t)(y - r - h0) * width, out, width, width, args->weights, args->n);
+		else
+			for (int i = 0; i < width; ++i)
+				vblur_pixel(scratch, out + i, i, y, h0, width, args);
+	}
+	phase_end();
+}
+
+// Copies the rows [done, upto) from the ring back into src
+static void write_back(void *arg, int rank, int num_threads)
+{
+	tiled_args *args = arg;
+	int rows = args->upto - args->done;
+	int y0 = args->done + rows * rank / num_threads;
+	int y1 = args->done + rows * (rank + 1) / num_threads;
+
+	for (int y = y0; y < y1; ++y)
+		memcpy(args->src + (size_t)y * args->xsize, ring_row(args, y), sizeof(pixel) * args->xsize);
+}
+
+void blurtiled(filter_pool *pool, const int xsize, const int ysize, pixel *src, const int radius, const double *w)
+{
+	int num_threads = pool_size(pool);
+
+	tiled_args args;
+	args.xsize = xsize;
+	args.ysize = ysize;
+	args.radius = radius;
+	args.src = src;
+	args.weights = w;
+	args.n = 0;
+	for (int wi = -radius; wi <= radius; wi++)
+		args.n += w[abs(wi)];
+	args.row = special_row_kernel(radius);
+	args.col = special_col_kernel(radius);
+
+	// The 2 * radius halo rows of a band are blurred horizontally by both
+	// bands they touch; bands of four radii or more bound that to half again
+	args.band = 4 * radius > TILE_ROWS ? 4 * radius : TILE_ROWS;
+	if (args.band > ysize)
+		args.band = ysize;
+	args.ring_rows = args.band + radius < ysize ? args.band + radius : ysize;
+
+	// Tiles as wide as the cache allows, but enough of them for the workers
+	int width = TILE_CACHE_BYTES / (sizeof(pixel) * (args.band + 2 * radius));
+	int share = (xsize + TILES_PER_WORKER * num_threads - 1) / (TILES_PER_WORKER * num_threads);
+	if (share < width)
+		width = share + MIN_TILE - 1;
+	width -= width % MIN_TILE;
+	args.width = width < MIN_TILE ? MIN_TILE : width;
+
+	args.ring = imgbuf_get(sizeof(pixel) * xsize * args.ring_rows);
+	args.scratch = malloc(sizeof(pixel) * (args.band + 2 * radius) * args.width * num_threads);
+	args.done = 0;
+
+	int tiles = (xsize + args.width - 1) / args.width;
+	for (args.y0 = 0; args.y0 < ysize; args.y0 = args.y1)
+	{
+		args.y1 = args.y0 + args.band < ysize ? args.y0 + args.band : ysize;
+		pool_for(pool, tiles, band_tile, &args);
+
+		// The next band still reads the last radius rows of this one
+		args.upto = args.y1 < ysize ? args.y1 - radius : ysize;
+		if (args.upto > args.done)
+		{
+			pool_run(pool, write_back, &args);
+			args.done = args.upto;
+		}
+	}
+
+	free(args.scratch);
+	imgbuf_put(args.ring);
+}
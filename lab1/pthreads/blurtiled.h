@@ -0,0 +1,20 @@
+/*
+  File: blurtiled.h
+  Declaration of the tiled blurfilter.
+ */
+
+#ifndef _BLURTILED_H_
+#define _BLURTILED_H_
+
+#include "blurfilter.h"
+
+/* Same interface and bit-identical output as blurfilter_pool, without the
+   image-sized intermediate. The image is processed in bands of rows, each
+   split into column tiles. A tile is blurred horizontally, with a radius
+   of halo rows, into a cache-sized scratch buffer of its worker and then
+   vertically into a ring of output rows. Rows go back into src once no
+   later band needs their original values, so the ring only holds a band
+   plus radius rows. */
+void blurtiled(filter_pool *pool, const int xsize, const int ysize, pixel *src, const int radius, const double *w);
+
+#endif
@@ -0,0 +1,145 @@
+/*
+  File: boxblur.c
+  Gaussian blur approximated by three stacked box filters. Each box is a
+  running sum, so the cost per pixel does not depend on the radius.
+ */
+
+#include <stdlib.h>
+#include <math.h>
+#include "boxblur.h"
+#include "../imgbuf.h"
+#include "../phases.h"
+
+#define BOXES 3
+
+typedef struct
+{
+	int xsize, ysize;
+	pixel *src, *dst;
+	int const *box;
+	filter_pool *pool;
+} box_args;
+
+double gauss_sigma(const int radius)
+{
+	// get_gauss_weights samples exp(-pi * (i * 1.33 / radius)^2), which is
+	// a Gaussian with sigma = radius / (1.33 * sqrt(2 * pi))
+	return radius / (1.33 * sqrt(2 * M_PI));
+}
+
+void box_radii(const double sigma, int *box)
+{
+	// Box widths whose stacked variance matches sigma^2 (widths wl and wl + 2)
+	int wl = floor(sqrt(12 * sigma * sigma / BOXES + 1));
+	if (wl % 2 == 0)
+		wl--;
+	int m = round((12 * sigma * sigma - BOXES * wl * wl - 4 * BOXES * wl - 3 * BOXES) / (-4.0 * wl - 4));
+
+	for (int i = 0; i < BOXES; ++i)
+		box[i] = ((i < m ? wl : wl + 2) - 1) / 2;
+}
+
+// Sliding-window mean of radius br over one line, renormalised at the ends
+static void box_line(const float *in, float *out, const int len, const int br)
+{
+	double sum = 0;
+	int lo = 0, hi = br < len - 1 ? br : len - 1;
+
+	for (int i = lo; i <= hi; ++i)
+		sum += in[i];
+
+	for (int i = 0; i < len; ++i)
+	{
+		out[i] = sum / (hi - lo + 1);
+		if (i + br + 1 < len)
+			sum += in[++hi];
+		if (i - br >= 0)
+			sum -= in[lo++];
+	}
+}
+
+// Blur one line of len pixels found at stride apart, from src into dst
+static void blur_line(pixel *src, pixel *dst, const int len, const int stride, int const *box, float *buf)
+{
+	float *ch[3] = {buf, buf + len, buf + 2 * len};
+	float *tmp = buf + 3 * len;
+
+	for (int i = 0; i < len; ++i)
+	{
+		ch[0][i] = src[(size_t)i * stride].r;
+		ch[1][i] = src[(size_t)i * stride].g;
+		ch[2][i] = src[(size_t)i * stride].b;
+	}
+
+	for (int c = 0; c < 3; ++c)
+		for (int k = 0; k < BOXES; ++k)
+		{
+			box_line(ch[c], tmp, len, box[k]);
+			float *t = ch[c];
+			ch[c] = tmp;
+			tmp = t;
+		}
+
+	for (int i = 0; i < len; ++i)
+	{
+		dst[(size_t)i * stride].r = ch[0][i] + 0.5f;
+		dst[(size_t)i * stride].g = ch[1][i] + 0.5f;
+		dst[(size_t)i * stride].b = ch[2][i] + 0.5f;
+	}
+}
+
+static void work(void *arg, int rank, int num_threads)
+{
+	box_args args = *(box_args *)arg;
+	int len = args.xsize > args.ysize ? args.xsize : args.ysize;
+	float *buf = malloc(sizeof(float) * 4 * len);
+
+	int thread_rows = args.ysize / num_threads;
+	int thread_cols = args.xsize / num_threads;
+
+	int start_row = rank * thread_rows;
+	int start_col = rank * thread_cols;
+
+	int end_row = start_row + thread_rows;
+	int end_col = start_col + thread_cols;
+
+	// Last thread does the remaining work
+	if (rank == num_threads - 1)
+	{
+		end_row += args.ysize % num_threads;
+		end_col += args.xsize % num_threads;
+	}
+
+	phase_begin(PHASE_HPASS);
+	for (int y = start_row; y < end_row; ++y)
+		blur_line(args.src + (size_t)y * args.xsize, args.dst + (size_t)y * args.xsize, args.xsize, 1, args.box, buf);
+	phase_end();
+
+	// Wait for all the rows to be blurred
+	pool_barrier(args.pool);
+
+	phase_begin(PHASE_VPASS);
+	for (int x = start_col; x < end_col; ++x)
+		blur_line(args.dst + x, args.src + x, args.ysize, args.xsize, args.box, buf);
+	phase_end();
+
+	free(buf);
+}
+
+void boxblur(filter_pool *pool, const int xsize, const int ysize, pixel *src, const int radius)
+{
+	int box[BOXES];
+	box_radii(gauss_sigma(radius), box);
+
+	box_args args;
+	args.xsize = xsize;
+	args.ysize = ysize;
+	args.src = src;
+	args.dst = (pixel *)imgbuf_get(sizeof(pixel) * xsize * ysize);
+	args.box = box;
+	args.pool = pool;
+
+	pool_run(pool, work, &args);
+
+	imgbuf_put(args.dst);
+}
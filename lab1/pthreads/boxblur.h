@@ -0,0 +1,23 @@
+/*
+  File: boxblur.h
+  Declaration of the stacked box approximation of the blurfilter.
+ */
+
+#ifndef _BOXBLUR_H_
+#define _BOXBLUR_H_
+
+#include "blurfilter.h"
+
+/* Standard deviation of the kernel get_gauss_weights builds for radius. */
+double gauss_sigma(const int radius);
+
+/* Radii of the three box filters whose composition approximates a Gaussian
+   of standard deviation sigma. */
+void box_radii(const double sigma, int *box);
+
+/* Same interface as blurfilter_pool, but the cost per pixel is independent of
+   radius. The result approximates the exact kernel to a few intensity
+   levels. */
+void boxblur(filter_pool *pool, const int xsize, const int ysize, pixel *src, const int radius);
+
+#endif
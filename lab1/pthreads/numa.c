@@ -0,0 +1,140 @@
+/*
+  File: numa.c
+  First-touch placement. Linux puts an anonymous page on the node of the
+  CPU that first writes it, so a buffer written block by block by pinned
+  workers ends up spread over their nodes without any NUMA library. Where
+  pages went is read back with move_pages, which only queries when no
+  target nodes are given.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "numa.h"
+
+// Pages asked about per move_pages call
+#define QUERY_PAGES 1024
+
+typedef struct
+{
+	int xsize, ysize;
+	const pixel *src;
+	pixel *dst;
+	int *cpu, *node; // per worker
+} place_args;
+
+// Rows [y0, y1) of worker rank, as pool_for hands out its first tiles
+static void row_block(const int ysize, const int rank, const int num_threads, int *y0, int *y1)
+{
+	*y0 = (long)ysize * rank / num_threads;
+	*y1 = (long)ysize * (rank + 1) / num_threads;
+}
+
+static size_t buf_len(const int xsize, const int ysize)
+{
+	return sizeof(pixel) * xsize * ysize;
+}
+
+static void touch_block(void *arg, int rank, int num_threads)
+{
+	place_args *args = arg;
+	int y0, y1;
+	row_block(args->ysize, rank, num_threads, &y0, &y1);
+
+	size_t first = (size_t)y0 * args->xsize;
+	memcpy(args->dst + first, args->src + first, buf_len(args->xsize, y1 - y0));
+}
+
+pixel *numa_place(filter_pool *pool, const int xsize, const int ysize, const pixel *src)
+{
+	// Fresh anonymous pages have no node until they are first written
+	pixel *buf = mmap(NULL, buf_len(xsize, ysize), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (buf == MAP_FAILED)
+	{
+		perror("numa_place");
+		return NULL;
+	}
+
+	place_args args = {xsize, ysize, src, buf, NULL, NULL};
+	pool_run(pool, touch_block, &args);
+	return buf;
+}
+
+void numa_free(pixel *buf, const int xsize, const int ysize)
+{
+	if (buf != NULL)
+		munmap(buf, buf_len(xsize, ysize));
+}
+
+static void locate(void *arg, int rank, int num_threads)
+{
+	place_args *args = arg;
+	unsigned cpu, node;
+
+	if (syscall(SYS_getcpu, &cpu, &node, NULL) != 0)
+		args->cpu[rank] = args->node[rank] = -1;
+	else
+	{
+		args->cpu[rank] = cpu;
+		args->node[rank] = node;
+	}
+}
+
+// Counts the pages of [begin, end) that are resident, and those of them on
+// node. Returns -1 when the kernel cannot tell.
+static int count_pages(const char *begin, const char *end, const int node, long *resident, long *local)
+{
+	long page = sysconf(_SC_PAGESIZE);
+	void *pages[QUERY_PAGES];
+	int status[QUERY_PAGES];
+
+	*resident = *local = 0;
+	begin -= (size_t)begin % page;
+	while (begin < end)
+	{
+		int n = 0;
+		for (; n < QUERY_PAGES && begin < end; ++n, begin += page)
+			pages[n] = (void *)begin;
+		if (syscall(SYS_move_pages, 0, n, pages, NULL, status, 0) != 0)
+			return -1;
+
+		// Pages never touched come back as -ENOENT
+		for (int i = 0; i < n; ++i)
+			if (status[i] >= 0)
+			{
+				++*resident;
+				*local += status[i] == node;
+			}
+	}
+	return 0;
+}
+
+void numa_report(filter_pool *pool, const int xsize, const int ysize, const pixel *buf)
+{
+	int num_threads = pool_size(pool);
+	place_args args = {xsize, ysize, buf, NULL, NULL, NULL};
+	args.cpu = malloc(sizeof(int) * num_threads);
+	args.node = malloc(sizeof(int) * num_threads);
+	pool_run(pool, locate, &args);
+
+	for (int t = 0; t < num_threads; ++t)
+	{
+		int y0, y1;
+		long resident, local;
+		row_block(ysize, t, num_threads, &y0, &y1);
+
+		const char *begin = (const char *)(buf + (size_t)y0 * xsize);
+		const char *end = (const char *)(buf + (size_t)y1 * xsize);
+		if (y0 == y1 || args.node[t] < 0 || count_pages(begin, end, args.node[t], &resident, &local) != 0)
+			printf("Worker %d: cpu %d node %d, placement of rows %d-%d unknown\n", t, args.cpu[t], args.node[t], y0, y1);
+		else
+			printf("Worker %d: cpu %d node %d, rows %d-%d: %ld of %ld pages local\n", t, args.cpu[t], args.node[t], y0, y1, local, resident);
+	}
+
+	free(args.node);
+	free(args.cpu);
+}
@@ -0,0 +1,24 @@
+/*
+  File: numa.h
+  First-touch placement of image buffers on the NUMA nodes of the workers.
+ */
+
+#ifndef _NUMA_H_
+#define _NUMA_H_
+
+#include "pixel.h"
+#include "pool.h"
+
+/* Copy of the xsize * ysize pixels of src in fresh pages. Worker t copies
+   (and so first touches) the t-th of pool_size(pool) equal blocks of rows,
+   the rows pool_for hands it first, so the pages of the block are placed
+   on the node of the CPU the worker is pinned to. Free with numa_free. */
+pixel *numa_place(filter_pool *pool, const int xsize, const int ysize, const pixel *src);
+
+void numa_free(pixel *buf, const int xsize, const int ysize);
+
+/* Prints the CPU and node of every worker and how many pages of its block
+   of rows in buf are on that node. */
+void numa_report(filter_pool *pool, const int xsize, const int ysize, const pixel *buf);
+
+#endif
@@ -0,0 +1,164 @@
+/*
+  File: pipeline.c
+  Filter pipeline: blur and threshold stages run back to back on one image
+  in memory. A threshold directly after a blur takes its histogram from the
+  blur's vertical pass instead of sweeping the image again.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pipeline.h"
+#include "blurfilter.h"
+#include "thresfilter.h"
+#include "../gaussw.h"
+#include "../phases.h"
+
+#define MAX_RAD 1000
+#define MAX_STAGES 16
+
+enum stage_kind
+{
+	STAGE_BLUR,
+	STAGE_THRES
+};
+
+typedef struct
+{
+	enum stage_kind kind;
+	int radius;
+	double *weights; // radius + 1 weights for a blur
+	enum thres_policy policy;
+	double param;
+} stage;
+
+struct filter_pipeline
+{
+	filter_pool *pool;
+	stage stages[MAX_STAGES];
+	int num_stages;
+	reduction *hist; // histogram of the blur feeding a threshold
+};
+
+filter_pipeline *pipeline_create(filter_pool *pool)
+{
+	filter_pipeline *pipe = calloc(1, sizeof(filter_pipeline));
+	pipe->pool = pool;
+	pipe->hist = reduction_create(pool_size(pool), HIST_BINS);
+	return pipe;
+}
+
+static stage *add_stage(filter_pipeline *pipe, enum stage_kind kind)
+{
+	if (pipe->num_stages == MAX_STAGES)
+	{
+		fprintf(stderr, "Too many stages, at most %d\n", MAX_STAGES);
+		exit(1);
+	}
+	stage *s = &pipe->stages[pipe->num_stages++];
+	memset(s, 0, sizeof(stage));
+	s->kind = kind;
+	return s;
+}
+
+void pipeline_add_blur(filter_pipeline *pipe, const int radius)
+{
+	stage *s = add_stage(pipe, STAGE_BLUR);
+	s->radius = radius;
+	s->weights = malloc(sizeof(double) * (MAX_RAD + 1));
+	phase_begin(PHASE_WEIGHTS);
+	get_gauss_weights(radius, s->weights);
+	phase_end();
+}
+
+void pipeline_add_thres(filter_pipeline *pipe, enum thres_policy policy, double param)
+{
+	stage *s = add_stage(pipe, STAGE_THRES);
+	s->policy = policy;
+	s->param = param;
+}
+
+int pipeline_parse(filter_pipeline *pipe, const char *spec)
+{
+	char *copy = strdup(spec), *save;
+	int ret = 0;
+
+	for (char *tok = strtok_r(copy, ",", &save); tok != NULL && ret == 0; tok = strtok_r(NULL, ",", &save))
+	{
+		if (strncmp(tok, "blur:", 5) == 0)
+		{
+			char *end;
+			long radius = strtol(tok + 5, &end, 10);
+			if (*end != '\0' || radius < 1 || radius > MAX_RAD)
+			{
+				fprintf(stderr, "Radius in %s must be between 1 and %d\n", tok, MAX_RAD);
+				ret = 1;
+			}
+			else
+				pipeline_add_blur(pipe, radius);
+		}
+		else if (strncmp(tok, "thres:", 6) == 0)
+		{
+			enum thres_policy policy;
+			double param;
+			if (parse_thres_policy(tok + 6, &policy, &param) != 0)
+			{
+				fprintf(stderr, "Policy in %s must be mean, otsu or percentile:P with 0 <= P <= 100\n", tok);
+				ret = 1;
+			}
+			else
+				pipeline_add_thres(pipe, policy, param);
+		}
+		else
+		{
+			fprintf(stderr, "Unknown stage %s\n", tok);
+			ret = 1;
+		}
+	}
+
+	free(copy);
+	if (ret == 0 && pipe->num_stages == 0)
+	{
+		fprintf(stderr, "No stages in %s\n", spec);
+		ret = 1;
+	}
+	return ret;
+}
+
+int pipeline_run(filter_pipeline *pipe, const int xsize, const int ysize, pixel *src)
+{
+	for (int i = 0; i < pipe->num_stages; ++i)
+	{
+		stage *s = &pipe->stages[i];
+		stage *next = i + 1 < pipe->num_stages ? &pipe->stages[i + 1] : NULL;
+
+		if (s->kind == STAGE_BLUR && next != NULL && next->kind == STAGE_THRES)
+		{
+			// Fused: the threshold only has to choose t and write the pixels
+			reduction_reset(pipe->hist);
+			blurfilter_hist(pipe->pool, xsize, ysize, src, s->radius, s->weights, pipe->hist);
+			int t = thresfilter_apply(pipe->pool, xsize, ysize, src, reduction_result(pipe->hist), next->policy, next->param);
+			printf("Stage %d-%d: blur %d, threshold %d\n", i + 1, i + 2, s->radius, t);
+			++i;
+		}
+		else if (s->kind == STAGE_BLUR)
+		{
+			blurfilter_pool(pipe->pool, xsize, ysize, src, s->radius, s->weights);
+			printf("Stage %d: blur %d\n", i + 1, s->radius);
+		}
+		else
+		{
+			int t = thresfilter_pool(pipe->pool, xsize, ysize, src, s->policy, s->param);
+			printf("Stage %d: threshold %d\n", i + 1, t);
+		}
+	}
+	return 0;
+}
+
+void pipeline_destroy(filter_pipeline *pipe)
+{
+	for (int i = 0; i < pipe->num_stages; ++i)
+		free(pipe->stages[i].weights);
+	reduction_destroy(pipe->hist);
+	free(pipe);
+}
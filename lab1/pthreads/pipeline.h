@@ -0,0 +1,36 @@
+/*
+  File: pipeline.h
+  Declaration of the filter pipeline: blur and threshold stages chained in
+  one process on one thread pool.
+ */
+
+#ifndef _PIPELINE_H_
+#define _PIPELINE_H_
+
+#include "pixel.h"
+#include "pool.h"
+#include "../histogram.h"
+
+typedef struct filter_pipeline filter_pipeline;
+
+/* An empty pipeline running on the workers of pool. */
+filter_pipeline *pipeline_create(filter_pool *pool);
+
+/* Appends a blur of the given radius; the weights are generated here. */
+void pipeline_add_blur(filter_pipeline *pipe, const int radius);
+
+/* Appends a threshold with the given policy. */
+void pipeline_add_thres(filter_pipeline *pipe, enum thres_policy policy, double param);
+
+/* Appends the stages of spec, e.g. "blur:5,thres:otsu" or
+   "blur:3,blur:8,thres:percentile:40". Returns 0 on success. */
+int pipeline_parse(filter_pipeline *pipe, const char *spec);
+
+/* Runs all stages over src in place. A blur directly followed by a
+   threshold builds the threshold histogram during its vertical pass.
+   Returns 0 on success. */
+int pipeline_run(filter_pipeline *pipe, const int xsize, const int ysize, pixel *src);
+
+void pipeline_destroy(filter_pipeline *pipe);
+
+#endif
@@ -0,0 +1,82 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include "../ppmio.h"
+#include "pipeline.h"
+#include "../phases.h"
+
+// Runs the pipeline over one image file into another
+static int pipe_image(filter_pipeline *pipe, const char *infile, const char *outfile)
+{
+	struct timespec stime, etime;
+	ppm_map img;
+
+	/* Map file */
+	phase_begin(PHASE_READ);
+	int mapped = map_ppm(infile, &img);
+	phase_end();
+	if (mapped != 0)
+		return 1;
+
+	if (img.channels != 3)
+	{
+		fprintf(stderr, "%s: the pipeline takes PPM (P6) images only\n", infile);
+		unmap_ppm(&img);
+		return 1;
+	}
+	if (img.max > 255)
+	{
+		fprintf(stderr, "Too large maximum color-component value\n");
+		unmap_ppm(&img);
+		return 1;
+	}
+
+	clock_gettime(CLOCK_REALTIME, &stime);
+	int ret = pipeline_run(pipe, img.xsize, img.ysize, (pixel *)img.data);
+	clock_gettime(CLOCK_REALTIME, &etime);
+	printf("Filtering took: %g secs\n", (etime.tv_sec - stime.tv_sec) + 1e-9 * (etime.tv_nsec - stime.tv_nsec));
+
+	// Write result
+	if (ret == 0)
+	{
+		printf("Writing output file\n");
+		phase_begin(PHASE_WRITE);
+		ret = write_ppm(outfile, img.xsize, img.ysize, img.data);
+		phase_end();
+	}
+	unmap_ppm(&img);
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	phases_init(argv[0], 0);
+
+	/* Take care of the arguments */
+	if (argc < 5 || argc % 2 == 0)
+	{
+		fprintf(stderr, "Usage: %s threads stages infile outfile [infile outfile ...]\n", argv[0]);
+		fprintf(stderr, "  stages: comma separated blur:RADIUS and thres:mean|otsu|percentile:P, e.g. blur:5,thres:otsu\n");
+		exit(1);
+	}
+
+	int threads = atoi(argv[1]);
+	if (threads < 1)
+	{
+		fprintf(stderr, "Threads (%d) must be greater than zero\n", threads);
+		exit(1);
+	}
+
+	/* One set of workers and stages for all the images */
+	filter_pool *pool = pool_create(threads, 1);
+	filter_pipeline *pipe = pipeline_create(pool);
+	if (pipeline_parse(pipe, argv[2]) != 0)
+		exit(1);
+
+	for (int f = 3; f < argc; f += 2)
+		if (pipe_image(pipe, argv[f], argv[f + 1]) != 0)
+			exit(1);
+
+	pipeline_destroy(pipe);
+	pool_destroy(pool);
+}
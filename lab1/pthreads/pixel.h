@@ -0,0 +1,14 @@
+/*
+  File: pixel.h
+  Declaration of the pixel structure shared by the pthreads filters.
+ */
+
+#ifndef _PIXEL_H_
+#define _PIXEL_H_
+
+/* NOTE: This structure must not be padded! */
+typedef struct _pixel {
+	unsigned char r,g,b;
+} pixel;
+
+#endif
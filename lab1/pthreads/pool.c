@@ -0,0 +1,270 @@
+/*
+  File: pool.c
+  Persistent filter thread pool. Workers are created once and wait for
+  tasks, so filtering many images does not create and join threads per call.
+  Tiled work is balanced by stealing ranges of tiles between workers.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <sched.h>
+#include "pool.h"
+#include "../phases.h"
+
+typedef struct
+{
+	filter_pool *pool;
+	int rank;
+} worker_args;
+
+// Tiles [head, tail) still owned by one worker. The owner takes from the
+// head, thieves take the upper half. Aligned so deques never share a line.
+typedef struct
+{
+	pthread_mutex_t lock;
+	int head, tail;
+} __attribute__((aligned(64))) tile_deque;
+
+typedef struct
+{
+	filter_pool *pool;
+	tile_task task;
+	pool_task finish;
+	void *arg;
+} tiles_args;
+
+struct filter_pool
+{
+	int num_threads;
+	pthread_t *threads;
+	worker_args *args;
+
+	pthread_mutex_t lock;
+	pthread_cond_t start, done;
+	pthread_barrier_t barrier;
+	tile_deque *deques;
+
+	pool_task task;
+	void *arg;
+	unsigned long generation; // bumped for every task
+	int running;              // workers still busy with the current task
+	double finished;          // clock when the last worker of a task was done
+	int quit;
+};
+
+static void *worker(void *arg)
+{
+	worker_args *wa = arg;
+	filter_pool *pool = wa->pool;
+	unsigned long seen = 0;
+	double done = 0;
+
+	phases_thread_start("worker", wa->rank);
+	for (;;)
+	{
+		pthread_mutex_lock(&pool->lock);
+		while (pool->generation == seen && !pool->quit)
+			pthread_cond_wait(&pool->start, &pool->lock);
+
+		// Waiting for the slowest worker of the previous task
+		if (seen > 0)
+			phase_add(PHASE_WAIT, pool->finished - done);
+		if (pool->quit)
+		{
+			pthread_mutex_unlock(&pool->lock);
+			break;
+		}
+		seen = pool->generation;
+		pool_task task = pool->task;
+		void *task_arg = pool->arg;
+		pthread_mutex_unlock(&pool->lock);
+
+		task(task_arg, wa->rank, pool->num_threads);
+		done = phase_clock();
+
+		pthread_mutex_lock(&pool->lock);
+		if (--pool->running == 0)
+		{
+			pool->finished = done;
+			pthread_cond_signal(&pool->done);
+		}
+		pthread_mutex_unlock(&pool->lock);
+	}
+	phases_thread_end();
+	return NULL;
+}
+
+// Bind thread to the (rank % allowed)-th CPU of the process affinity mask
+static void pin_thread(pthread_t thread, int rank)
+{
+	cpu_set_t allowed, cpu;
+	if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+		return;
+
+	int count = CPU_COUNT(&allowed), nth = rank % count;
+	for (int c = 0; c < CPU_SETSIZE; ++c)
+	{
+		if (!CPU_ISSET(c, &allowed) || nth-- > 0)
+			continue;
+		CPU_ZERO(&cpu);
+		CPU_SET(c, &cpu);
+		if (pthread_setaffinity_np(thread, sizeof(cpu), &cpu) != 0)
+			fprintf(stderr, "Could not pin worker %d to cpu %d\n", rank, c);
+		return;
+	}
+}
+
+filter_pool *pool_create(const int num_threads, const int pin)
+{
+	filter_pool *pool = calloc(1, sizeof(filter_pool));
+	pool->num_threads = num_threads;
+	pool->threads = malloc(sizeof(pthread_t) * num_threads);
+	pool->args = malloc(sizeof(worker_args) * num_threads);
+
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->start, NULL);
+	pthread_cond_init(&pool->done, NULL);
+	pthread_barrier_init(&pool->barrier, NULL, num_threads);
+
+	if (posix_memalign((void **)&pool->deques, 64, sizeof(tile_deque) * num_threads) != 0)
+	{
+		perror("pool_create");
+		exit(1);
+	}
+	for (int t = 0; t < num_threads; ++t)
+	{
+		pthread_mutex_init(&pool->deques[t].lock, NULL);
+		pool->deques[t].head = pool->deques[t].tail = 0;
+	}
+
+	for (int t = 0; t < num_threads; ++t)
+	{
+		pool->args[t].pool = pool;
+		pool->args[t].rank = t;
+		pthread_create(&pool->threads[t], NULL, worker, &pool->args[t]);
+		if (pin)
+			pin_thread(pool->threads[t], t);
+	}
+	return pool;
+}
+
+void pool_run(filter_pool *pool, pool_task task, void *arg)
+{
+	pthread_mutex_lock(&pool->lock);
+	pool->task = task;
+	pool->arg = arg;
+	pool->running = pool->num_threads;
+	pool->generation++;
+	pthread_cond_broadcast(&pool->start);
+	while (pool->running > 0)
+		pthread_cond_wait(&pool->done, &pool->lock);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+// Next tile for worker rank, stolen from another worker if need be.
+// Returns 0 once every deque is empty.
+static int next_tile(filter_pool *pool, int rank, int *tile)
+{
+	tile_deque *own = &pool->deques[rank];
+
+	pthread_mutex_lock(&own->lock);
+	if (own->head < own->tail)
+	{
+		*tile = own->head++;
+		pthread_mutex_unlock(&own->lock);
+		return 1;
+	}
+	pthread_mutex_unlock(&own->lock);
+
+	for (int i = 1; i < pool->num_threads; ++i)
+	{
+		tile_deque *victim = &pool->deques[(rank + i) % pool->num_threads];
+
+		pthread_mutex_lock(&victim->lock);
+		int left = victim->tail - victim->head;
+		if (left <= 0)
+		{
+			pthread_mutex_unlock(&victim->lock);
+			continue;
+		}
+		int take = (left + 1) / 2;
+		int first = victim->tail - take;
+		victim->tail = first;
+		pthread_mutex_unlock(&victim->lock);
+
+		// Keep the first stolen tile, queue the rest as our own
+		pthread_mutex_lock(&own->lock);
+		own->head = first + 1;
+		own->tail = first + take;
+		pthread_mutex_unlock(&own->lock);
+		*tile = first;
+		return 1;
+	}
+	return 0;
+}
+
+static void run_tiles(void *arg, int rank, int num_threads)
+{
+	tiles_args *ta = arg;
+	int tile;
+
+	while (next_tile(ta->pool, rank, &tile))
+		ta->task(ta->arg, tile, rank);
+
+	if (ta->finish != NULL)
+		ta->finish(ta->arg, rank, num_threads);
+}
+
+void pool_for(filter_pool *pool, const int num_tiles, tile_task task, void *arg)
+{
+	pool_for_finish(pool, num_tiles, task, NULL, arg);
+}
+
+void pool_for_finish(filter_pool *pool, const int num_tiles, tile_task task, pool_task finish, void *arg)
+{
+	// Workers are idle here, so the deques can be refilled without locking
+	for (int t = 0; t < pool->num_threads; ++t)
+	{
+		pool->deques[t].head = (long)num_tiles * t / pool->num_threads;
+		pool->deques[t].tail = (long)num_tiles * (t + 1) / pool->num_threads;
+	}
+
+	tiles_args ta = {pool, task, finish, arg};
+	pool_run(pool, run_tiles, &ta);
+}
+
+void pool_barrier(filter_pool *pool)
+{
+	phase_begin(PHASE_WAIT);
+	pthread_barrier_wait(&pool->barrier);
+	phase_end();
+}
+
+int pool_size(const filter_pool *pool)
+{
+	return pool->num_threads;
+}
+
+void pool_destroy(filter_pool *pool)
+{
+	pthread_mutex_lock(&pool->lock);
+	pool->quit = 1;
+	pthread_cond_broadcast(&pool->start);
+	pthread_mutex_unlock(&pool->lock);
+
+	for (int t = 0; t < pool->num_threads; ++t)
+		pthread_join(pool->threads[t], NULL);
+
+	for (int t = 0; t < pool->num_threads; ++t)
+		pthread_mutex_destroy(&pool->deques[t].lock);
+	free(pool->deques);
+	pthread_barrier_destroy(&pool->barrier);
+	pthread_cond_destroy(&pool->done);
+	pthread_cond_destroy(&pool->start);
+	pthread_mutex_destroy(&pool->lock);
+	free(pool->args);
+	free(pool->threads);
+	free(pool);
+}
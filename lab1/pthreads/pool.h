@@ -0,0 +1,46 @@
+/*
+  File: pool.h
+  Declaration of the persistent filter thread pool.
+ */
+
+#ifndef _POOL_H_
+#define _POOL_H_
+
+typedef struct filter_pool filter_pool;
+
+/* A task is run once on every worker of the pool. */
+typedef void (*pool_task)(void *arg, int rank, int num_threads);
+
+/* A tile task is run once per tile, on whichever worker picks the tile. */
+typedef void (*tile_task)(void *arg, int tile, int rank);
+
+/* Tiles handed to each worker up front; the surplus feeds the stealing. */
+#define TILES_PER_WORKER 8
+
+/* Starts num_threads workers that live until pool_destroy. With pin set,
+   worker t is bound to the t-th CPU the process may run on (modulo). */
+filter_pool *pool_create(const int num_threads, const int pin);
+
+/* Runs task(arg, rank, num_threads) on every worker and returns when all
+   of them are done. */
+void pool_run(filter_pool *pool, pool_task task, void *arg);
+
+/* Runs task(arg, tile, rank) for every tile in [0, num_tiles) and returns
+   when all are done. Each worker starts on its own contiguous block of
+   tiles and, once that runs dry, steals half of the remaining tiles of
+   another worker. Works for any number of workers. */
+void pool_for(filter_pool *pool, const int num_tiles, tile_task task, void *arg);
+
+/* As pool_for, but every worker runs finish(arg, rank, num_threads) once
+   no tiles are left for it, e.g. to combine per-worker results. */
+void pool_for_finish(filter_pool *pool, const int num_tiles, tile_task task, pool_task finish, void *arg);
+
+/* Barrier across all workers, callable from inside a task. */
+void pool_barrier(filter_pool *pool);
+
+int pool_size(const filter_pool *pool);
+
+/* Stops and joins the workers. */
+void pool_destroy(filter_pool *pool);
+
+#endif
@@ -0,0 +1,112 @@
+/*
+  File: pyramid.c
+  Gaussian scale-space pyramid. Blurring with radius a and then radius b
+  gives about the blur of radius sqrt(a^2 + b^2), so each level only adds
+  the difference to the one before it, and with octaves the large radii
+  are blurred on an image a quarter or less of the size.
+ */
+
+#include <math.h>
+#include "pyramid.h"
+#include "../phases.h"
+
+// Bytes per tile of pyramid_unbias
+#define UNBIAS_CHUNK (64 << 10)
+
+typedef struct
+{
+	size_t len;
+	unsigned char *buf;
+} unbias_args;
+
+typedef struct
+{
+	int xsize, ysize, channels;
+	const unsigned char *src;
+	unsigned char *dst;
+	int band; // output rows per tile
+} halve_args;
+
+void pyramid_plan(const int n, const int *radii, const int octaves, pyramid_level *levels)
+{
+	double blurred = 0; // sum of squared radii blurred, in input pixels
+	int shift = 0;
+
+	for (int i = 0; i < n; ++i)
+	{
+		if (octaves && i > 0 && (radii[i - 1] >> shift) >= OCTAVE_RADIUS)
+			++shift;
+
+		double rest = (double)radii[i] * radii[i] - blurred;
+		int residual = rest > 0 ? lround(sqrt(rest) / (1 << shift)) : 0;
+
+		levels[i].radius = radii[i];
+		levels[i].shift = shift;
+		levels[i].direct = i == 0 || residual < MIN_CHAIN_RADIUS || (radii[i - 1] >> shift) < MIN_CHAIN_RADIUS;
+		if (levels[i].direct)
+		{
+			levels[i].residual = radii[i];
+			blurred = (double)radii[i] * radii[i];
+		}
+		else
+		{
+			levels[i].residual = residual;
+			blurred += (double)(residual << shift) * (residual << shift);
+		}
+	}
+}
+
+static void unbias_tile(void *arg, int tile, int rank)
+{
+	unbias_args *args = arg;
+	size_t end = (size_t)(tile + 1) * UNBIAS_CHUNK < args->len ? (size_t)(tile + 1) * UNBIAS_CHUNK : args->len;
+
+	phase_begin(PHASE_RESAMPLE);
+	for (size_t i = (size_t)tile * UNBIAS_CHUNK; i < end; ++i)
+		args->buf[i] += args->buf[i] < 255;
+	phase_end();
+}
+
+void pyramid_unbias(filter_pool *pool, const size_t len, unsigned char *buf)
+{
+	unbias_args args = {len, buf};
+	pool_for(pool, (len + UNBIAS_CHUNK - 1) / UNBIAS_CHUNK, unbias_tile, &args);
+}
+
+static void halve_tile(void *arg, int tile, int rank)
+{
+	halve_args *args = arg;
+	int channels = args->channels;
+	int half_x = (args->xsize + 1) / 2, half_y = (args->ysize + 1) / 2;
+	int end_row = (tile + 1) * args->band < half_y ? (tile + 1) * args->band : half_y;
+
+	phase_begin(PHASE_RESAMPLE);
+	for (int y = tile * args->band; y < end_row; ++y)
+	{
+		const unsigned char *in0 = args->src + (size_t)2 * y * args->xsize * channels;
+		const unsigned char *in1 = 2 * y + 1 < args->ysize ? in0 + (size_t)args->xsize * channels : in0;
+		unsigned char *out = args->dst + (size_t)y * half_x * channels;
+
+		for (int x = 0; x < half_x; ++x)
+		{
+			// A missing column or row repeats the last one, which averages
+			// over the pixels that are there
+			int x0 = 2 * x * channels;
+			int x1 = 2 * x + 1 < args->xsize ? x0 + channels : x0;
+			for (int c = 0; c < channels; ++c)
+				out[x * channels + c] = (in0[x0 + c] + in0[x1 + c] + in1[x0 + c] + in1[x1 + c] + 2) >> 2;
+		}
+	}
+	phase_end();
+}
+
+void pyramid_halve(filter_pool *pool, const int xsize, const int ysize, const int channels, const unsigned char *src, unsigned char *dst)
+{
+	halve_args args = {xsize, ysize, channels, src, dst, 0};
+	int half_y = (ysize + 1) / 2;
+
+	args.band = half_y / (TILES_PER_WORKER * pool_size(pool));
+	if (args.band < 1)
+		args.band = 1;
+	pool_for(pool, (half_y + args.band - 1) / args.band, halve_tile, &args);
+}
@@ -0,0 +1,54 @@
+/*
+  File: pyramid.h
+  Declaration of the Gaussian scale-space pyramid helpers.
+ */
+
+#ifndef _PYRAMID_H_
+#define _PYRAMID_H_
+
+#include <stddef.h>
+#include "pool.h"
+
+/* With octaves on, a level is taken from the previous one at half the
+   size once the previous one is blurred by at least this radius in its
+   own pixels, so that halving it loses next to nothing. A level at shift
+   s is the input blurred by its radius and then averaged over blocks of
+   2^s by 2^s pixels, which keeps its border on the border of the input. */
+#define OCTAVE_RADIUS 8
+
+/* Kernels of a smaller radius are too far from a gaussian for their
+   variances to add up: a level whose residual radius, or whose previous
+   level's radius, is below this many of its pixels is blurred from the
+   input instead. */
+#define MIN_CHAIN_RADIUS 4
+
+typedef struct
+{
+	int radius;   // blur of the level, in pixels of the input image
+	int shift;    // the level is the input halved shift times
+	int residual; // radius blurred onto the previous level, in pixels of this level
+	int direct;   // blurred from the input by radius instead, then halved
+} pyramid_level;
+
+/* Plans the levels for the n strictly increasing radii. Level 0 is the
+   input blurred by radii[0]; every other level blurs the previous one by
+   only the remaining radius, as the variances of the gaussian kernels
+   add up: sqrt(radius^2 - blurred^2), where blurred^2 is the sum of the
+   squared radii blurred so far, so rounding does not pile up. Levels the
+   residual cannot reach within MIN_CHAIN_RADIUS start over from the
+   input. */
+void pyramid_plan(const int n, const int *radii, const int octaves, pyramid_level *levels);
+
+/* The blur kernels round their outputs down, which costs a level about
+   one unit per blur; a direct blur pays that once, a level blurred from
+   the one before it once more per level. Adds that unit back to the len
+   bytes of buf, saturating, ahead of blurring the next level. */
+void pyramid_unbias(filter_pool *pool, const size_t len, unsigned char *buf);
+
+/* Averages every 2x2 block of the xsize * ysize image src, of channels
+   bytes per pixel, into one pixel of dst, (xsize + 1) / 2 by
+   (ysize + 1) / 2 pixels. Past an odd size the last column or row of
+   blocks only averages the pixels that are there. */
+void pyramid_halve(filter_pool *pool, const int xsize, const int ysize, const int channels, const unsigned char *src, unsigned char *dst);
+
+#endif
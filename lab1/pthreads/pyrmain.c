@@ -0,0 +1,241 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "../ppmio.h"
+#include "blurfilter.h"
+#include "blurgray.h"
+#include "pyramid.h"
+#include "../imgbuf.h"
+#include "../gaussw.h"
+#include "../phases.h"
+
+#define MAX_RAD 1000
+#define MAX_LEVELS 64
+
+// Blurs the xsize * ysize image of channels bytes per pixel in place
+static void blur_level(filter_pool *pool, const int xsize, const int ysize, const int channels, unsigned char *buf, const int radius)
+{
+	double w[MAX_RAD + 1];
+
+	phase_begin(PHASE_WEIGHTS);
+	get_gauss_weights(radius, w);
+	phase_end();
+
+	if (channels == 1)
+		blurgray(pool, xsize, ysize, buf, radius, w);
+	else
+		blurfilter_pool(pool, xsize, ysize, (pixel *)buf, radius, w);
+}
+
+// The input blurred by radius in one go and halved shift times, in a new
+// buffer; *xsize and *ysize go from the size of the input to that of the level
+static unsigned char *blur_direct(filter_pool *pool, const unsigned char *input, int *xsize, int *ysize, const int channels,
+								  const int radius, const int shift)
+{
+	size_t len = (size_t)*xsize * *ysize * channels;
+	unsigned char *buf = imgbuf_get(len);
+	memcpy(buf, input, len);
+	blur_level(pool, *xsize, *ysize, channels, buf, radius);
+
+	for (int s = 0; s < shift; ++s)
+	{
+		unsigned char *half = imgbuf_get((size_t)((*xsize + 1) / 2) * ((*ysize + 1) / 2) * channels);
+		pyramid_halve(pool, *xsize, *ysize, channels, buf, half);
+		imgbuf_put(buf);
+		buf = half;
+		*xsize = (*xsize + 1) / 2;
+		*ysize = (*ysize + 1) / 2;
+	}
+	return buf;
+}
+
+// Largest and mean absolute difference between two images of len bytes,
+// with where the largest one is
+static void report_error(const int xsize, const int channels, const size_t len, const unsigned char *level, const unsigned char *direct)
+{
+	int max = 0;
+	size_t at = 0;
+	double sum = 0;
+
+	for (size_t i = 0; i < len; ++i)
+	{
+		int d = abs(level[i] - direct[i]);
+		if (d > max)
+		{
+			max = d;
+			at = i / channels;
+		}
+		sum += d;
+	}
+	printf("Error against a direct blur: max %d at (%d, %d), mean %g\n", max, (int)(at % xsize), (int)(at / xsize), sum / len);
+}
+
+int main(int argc, char **argv)
+{
+	struct timespec stime, etime;
+	int octaves = 0, check = 0, luma = 0;
+
+	phases_init(argv[0], 0);
+
+	/* Take care of the arguments */
+	int opt;
+	while ((opt = getopt(argc, argv, "oeg")) != -1)
+	{
+		switch (opt)
+		{
+		case 'o':
+			octaves = 1;
+			break;
+		case 'e':
+			check = 1;
+			break;
+		case 'g':
+			luma = 1;
+			break;
+		default:
+			argc = 0;
+		}
+	}
+	// Drop the options, keeping the program name in argv[0]
+	argv[optind - 1] = argv[0];
+	argc -= optind - 1;
+	argv += optind - 1;
+
+	if (argc < 5 || argc - 4 > MAX_LEVELS)
+	{
+		fprintf(stderr, "Usage: %s [-o] [-e] [-g] threads infile outprefix radius [radius ...]\n", argv[0]);
+		fprintf(stderr, "  writes the input blurred by each radius to outprefix0.ppm, outprefix1.ppm, ... (.pgm for gray)\n");
+		fprintf(stderr, "  levels the previous one cannot reach with a radius of %d or more are blurred from the input\n", MIN_CHAIN_RADIUS);
+		fprintf(stderr, "  -o: halve the image for the next level once a level is blurred by %d of its pixels\n", OCTAVE_RADIUS);
+		fprintf(stderr, "  -e: report the error of every level against a direct blur of the input\n");
+		fprintf(stderr, "  -g: blur the luma of PPM input, PGM (P5) input is always blurred as gray\n");
+		fprintf(stderr, "  at most %d radii, increasing\n", MAX_LEVELS);
+		exit(1);
+	}
+
+	int threads = atoi(argv[1]);
+	if (threads < 1)
+	{
+		fprintf(stderr, "Threads (%d) must be greater than zero\n", threads);
+		exit(1);
+	}
+
+	int num_levels = argc - 4;
+	int radii[MAX_LEVELS];
+	for (int i = 0; i < num_levels; ++i)
+	{
+		radii[i] = atoi(argv[4 + i]);
+		if ((radii[i] > MAX_RAD) || (radii[i] < 1))
+		{
+			fprintf(stderr, "Radius (%d) must be greater than zero and less then %d\n", radii[i], MAX_RAD);
+			exit(1);
+		}
+		if (i > 0 && radii[i] <= radii[i - 1])
+		{
+			fprintf(stderr, "Radii must be increasing (%d after %d)\n", radii[i], radii[i - 1]);
+			exit(1);
+		}
+	}
+
+	pyramid_level levels[MAX_LEVELS];
+	pyramid_plan(num_levels, radii, octaves, levels);
+
+	/* Map file */
+	ppm_map img;
+	phase_begin(PHASE_READ);
+	int mapped = map_ppm(argv[2], &img);
+	phase_end();
+	if (mapped != 0)
+		exit(1);
+
+	if (img.max > 255)
+	{
+		fprintf(stderr, "Too large maximum color-component value\n");
+		exit(1);
+	}
+
+	filter_pool *pool = pool_create(threads, 1);
+
+	// Levels blurred directly start from a copy of the input, gray when
+	// asked for
+	int xsize = img.xsize, ysize = img.ysize;
+	int channels = luma ? 1 : img.channels;
+	size_t full = (size_t)xsize * ysize;
+	unsigned char *input = imgbuf_get(full * channels), *buf = NULL;
+	phase_begin(PHASE_READ);
+	if (channels != img.channels)
+		rgb_to_luma(img.data, (char *)input, full);
+	else
+		memcpy(input, img.data, full * channels);
+	phase_end();
+	unmap_ppm(&img);
+
+	double total = 0, work = 0;
+	int sum_radii = 0;
+	for (int i = 0; i < num_levels; ++i)
+	{
+		clock_gettime(CLOCK_REALTIME, &stime);
+		if (levels[i].direct)
+		{
+			imgbuf_put(buf);
+			xsize = img.xsize;
+			ysize = img.ysize;
+			buf = blur_direct(pool, input, &xsize, &ysize, channels, radii[i], levels[i].shift);
+		}
+		else
+		{
+			if (levels[i].shift > levels[i - 1].shift)
+			{
+				unsigned char *half = imgbuf_get((size_t)((xsize + 1) / 2) * ((ysize + 1) / 2) * channels);
+				pyramid_halve(pool, xsize, ysize, channels, buf, half);
+				imgbuf_put(buf);
+				buf = half;
+				xsize = (xsize + 1) / 2;
+				ysize = (ysize + 1) / 2;
+			}
+			pyramid_unbias(pool, (size_t)xsize * ysize * channels, buf);
+			blur_level(pool, xsize, ysize, channels, buf, levels[i].residual);
+		}
+		clock_gettime(CLOCK_REALTIME, &etime);
+
+		double secs = (etime.tv_sec - stime.tv_sec) + 1e-9 * (etime.tv_nsec - stime.tv_nsec);
+		total += secs;
+		sum_radii += radii[i];
+		if (levels[i].direct)
+		{
+			work += radii[i];
+			printf("Level %d: radius %d directly, on %dx%d, took %g secs\n", i, radii[i], xsize, ysize, secs);
+		}
+		else
+		{
+			work += (double)levels[i].residual * xsize * ysize / full;
+			printf("Level %d: radius %d as %d on %dx%d, took %g secs\n", i, radii[i], levels[i].residual, xsize, ysize, secs);
+		}
+
+		if (check)
+		{
+			int x = img.xsize, y = img.ysize;
+			unsigned char *direct = blur_direct(pool, input, &x, &y, channels, radii[i], levels[i].shift);
+			report_error(xsize, channels, (size_t)xsize * ysize * channels, buf, direct);
+			imgbuf_put(direct);
+		}
+
+		char outfile[4096];
+		snprintf(outfile, sizeof(outfile), "%s%d.%s", argv[3], i, channels == 1 ? "pgm" : "ppm");
+		phase_begin(PHASE_WRITE);
+		int ret = write_pnm(outfile, xsize, ysize, channels, (char *)buf);
+		phase_end();
+		if (ret != 0)
+			exit(1);
+	}
+
+	// Blurring costs about radius times pixels, so the sum of the radii is
+	// the work of blurring every level from the input on its own
+	printf("Pyramid took: %g secs, work of radius %g at full size in place of %d\n", total, work, sum_radii);
+
+	imgbuf_put(input);
+	imgbuf_put(buf);
+	pool_destroy(pool);
+}
@@ -0,0 +1,98 @@
+/*
+  File: reduce.c
+  Lock-free reduction of per-worker counters. Every worker adds into its
+  own padded slot, the slots are combined with an atomic flag per slot
+  instead of a mutex and a separate barrier.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <sched.h>
+#include "reduce.h"
+
+#define CACHE_LINE 64
+
+typedef struct
+{
+	atomic_ulong round; // last round this slot was published in
+} __attribute__((aligned(CACHE_LINE))) ready_flag;
+
+struct reduction
+{
+	int num_slots;
+	size_t stride; // counters per slot, rounded up to whole cache lines
+	uint64_t *slots;
+	ready_flag *ready;
+	unsigned long round;
+};
+
+reduction *reduction_create(const int num_slots, const int len)
+{
+	reduction *red = calloc(1, sizeof(reduction));
+	red->num_slots = num_slots;
+	red->stride = (len * sizeof(uint64_t) + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE / sizeof(uint64_t);
+
+	if (posix_memalign((void **)&red->slots, CACHE_LINE, red->stride * sizeof(uint64_t) * num_slots) != 0 ||
+		posix_memalign((void **)&red->ready, CACHE_LINE, sizeof(ready_flag) * num_slots) != 0)
+	{
+		perror("reduction_create");
+		exit(1);
+	}
+	for (int s = 0; s < num_slots; ++s)
+		atomic_init(&red->ready[s].round, 0);
+
+	reduction_reset(red);
+	return red;
+}
+
+void reduction_reset(reduction *red)
+{
+	memset(red->slots, 0, red->stride * sizeof(uint64_t) * red->num_slots);
+	red->round++;
+}
+
+uint64_t *reduction_slot(reduction *red, const int rank)
+{
+	return red->slots + red->stride * rank;
+}
+
+void reduction_combine(reduction *red, const int rank, const int num_threads)
+{
+	uint64_t *mine = reduction_slot(red, rank);
+
+	for (int step = 1; step < num_threads; step <<= 1)
+	{
+		if (rank & step)
+		{
+			// Our partial sum is complete, hand it to rank - step
+			atomic_store_explicit(&red->ready[rank].round, red->round, memory_order_release);
+			return;
+		}
+
+		int partner = rank + step;
+		if (partner >= num_threads)
+			continue;
+
+		// Yield while waiting, workers may outnumber the cores
+		while (atomic_load_explicit(&red->ready[partner].round, memory_order_acquire) != red->round)
+			sched_yield();
+
+		uint64_t *theirs = reduction_slot(red, partner);
+		for (size_t i = 0; i < red->stride; ++i)
+			mine[i] += theirs[i];
+	}
+}
+
+uint64_t *reduction_result(reduction *red)
+{
+	return red->slots;
+}
+
+void reduction_destroy(reduction *red)
+{
+	free(red->ready);
+	free(red->slots);
+	free(red);
+}
@@ -0,0 +1,33 @@
+/*
+  File: reduce.h
+  Declaration of the lock-free reduction of per-worker counters.
+ */
+
+#ifndef _REDUCE_H_
+#define _REDUCE_H_
+
+#include <stdint.h>
+
+typedef struct reduction reduction;
+
+/* num_slots slots of len 64-bit counters, each on its own cache lines. */
+reduction *reduction_create(const int num_slots, const int len);
+
+/* Zeroes all slots and starts a new round. Call while no worker uses it. */
+void reduction_reset(reduction *red);
+
+/* Counters of worker rank; only that worker may touch them. */
+uint64_t *reduction_slot(reduction *red, const int rank);
+
+/* Called once by every worker when it is done adding to its slot. Slots
+   are summed pairwise up a binary tree: a worker waits only for its own
+   partners, publishes its partial sum and leaves. Once all num_threads
+   workers have called it, slot 0 holds the total. */
+void reduction_combine(reduction *red, const int rank, const int num_threads);
+
+/* The total, valid after every worker has called reduction_combine. */
+uint64_t *reduction_result(reduction *red);
+
+void reduction_destroy(reduction *red);
+
+#endif
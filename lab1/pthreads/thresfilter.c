@@ -1,75 +1,198 @@
 #include "thresfilter.h"
-#include <pthread.h>
+#include "reduce.h"
+#include "../phases.h"
 #include <stdlib.h>
 #include <stdio.h>
-
-typedef unsigned int uint;
+#include <string.h>
 
 typedef struct
 {
 	pixel *src;
-	int N, begin, end;
-	uint *sum;
+	unsigned char *gray; // single-channel image used instead of src, or NULL
+	int N, chunksize;
+	reduction *hist; // one histogram per worker
+	unsigned char lut[HIST_BINS];
+	int xsize, ysize, band, t; // rows per tile and threshold of pack_tile
+	unsigned char *bits;       // PBM rows written by pack_tile
 } thread_args;
 
-pthread_mutex_t sum_lock;
-pthread_barrier_t barrier;
+static void chunk(thread_args *args, int tile, int *begin, int *end)
+{
+	*begin = tile * args->chunksize;
+	*end = *begin + args->chunksize < args->N ? *begin + args->chunksize : args->N;
+}
+
+static void hist_tile(void *arg, int tile, int rank)
+{
+	thread_args *args = arg;
+	int begin, end;
+	chunk(args, tile, &begin, &end);
+
+	// Histogram of r+g+b over all the pixels of the tile
+	phase_begin(PHASE_HIST);
+	if (args->gray != NULL)
+		hist_add_gray(reduction_slot(args->hist, rank), args->gray + begin, end - begin);
+	else
+		hist_add(reduction_slot(args->hist, rank), &args->src[begin].r, end - begin);
+	phase_end();
+}
 
-void *work(void *arg)
+static void merge_hist(void *arg, int rank, int num_threads)
 {
-	thread_args args = *(thread_args *)arg;
+	thread_args *args = arg;
+	reduction_combine(args->hist, rank, num_threads);
+}
 
-	// Sum over all my pixels
-	uint local_sum = 0;
-	for (int i = args.begin; i < args.end; ++i)
-		local_sum += args.src[i].r + args.src[i].g + args.src[i].b;
+static void set_tile(void *arg, int tile, int rank)
+{
+	thread_args *args = arg;
+	int begin, end;
+	chunk(args, tile, &begin, &end);
 
-	pthread_mutex_lock(&sum_lock);
-	*args.sum += local_sum;
-	pthread_mutex_unlock(&sum_lock);
+	// Set values for all the pixels of the tile
+	phase_begin(PHASE_APPLY);
+	if (args->gray != NULL)
+		thres_apply_gray(args->gray + begin, end - begin, args->lut);
+	else
+		thres_apply(&args->src[begin].r, end - begin, args->lut);
+	phase_end();
+}
 
-	pthread_barrier_wait(&barrier);
-	uint avg = *args.sum / args.N;
+// Binarises the rows of one band straight into PBM rows
+static void pack_tile(void *arg, int tile, int rank)
+{
+	thread_args *args = arg;
+	int end_row = (tile + 1) * args->band < args->ysize ? (tile + 1) * args->band : args->ysize;
+	size_t row_bytes = PBM_ROW_BYTES(args->xsize);
 
-	// Set values for all my pixels
-	for (int i = args.begin; i < args.end; ++i)
+	phase_begin(PHASE_APPLY);
+	for (int y = tile * args->band; y < end_row; ++y)
 	{
-		uint psum = args.src[i].r + args.src[i].g + args.src[i].b;
-		if (avg > psum)
-			args.src[i].r = args.src[i].g = args.src[i].b = 0;
+		if (args->gray != NULL)
+			thres_pack_gray(args->gray + (size_t)y * args->xsize, args->xsize, args->t, args->bits + y * row_bytes);
 		else
-			args.src[i].r = args.src[i].g = args.src[i].b = 255;
+			thres_pack(&args->src[(size_t)y * args->xsize].r, args->xsize, args->t, args->bits + y * row_bytes);
 	}
-	free(arg);
+	phase_end();
 }
 
-void thresfilter(const int xsize, const int ysize, pixel *src, int thread_count)
+// Splits the args->N pixels into tiles of args->chunksize and returns how
+// many; none for a block without pixels, e.g. a rank that owns no rows
+static int pixel_tiles(filter_pool *pool, thread_args *args)
 {
-	pthread_barrier_init(&barrier, NULL, thread_count);
-	pthread_mutex_init(&sum_lock, NULL);
+	if (args->N == 0)
+		return 0;
 
-	int N = xsize * ysize;
-	int chunksize = N / thread_count;
-	unsigned int sum = 0;
+	int tiles = TILES_PER_WORKER * pool_size(pool);
+	args->chunksize = (args->N + tiles - 1) / tiles;
+	return (args->N + args->chunksize - 1) / args->chunksize;
+}
 
-	pthread_t *threads = malloc(thread_count * sizeof(thread_args));
-	for (int i = 0; i < thread_count; ++i)
-	{
-		thread_args *args = malloc(sizeof(thread_args));
-		args->src = src;
-		args->begin = i * chunksize;
-		args->end = args->begin + chunksize;
-		if (i == thread_count - 1)
-			args->end += N % thread_count;
-		args->sum = &sum;
-		args->N = N;
-		pthread_create(threads + i, NULL, work, args);
-	}
+void thresfilter_histogram(filter_pool *pool, const int xsize, const int ysize, pixel *src, uint64_t *hist)
+{
+	thread_args args;
+	args.src = src;
+	args.gray = NULL;
+	args.N = xsize * ysize;
+	args.hist = reduction_create(pool_size(pool), HIST_BINS);
 
-	for (int i = 0; i < thread_count; ++i)
-		pthread_join(threads[i], NULL);
-	free(threads);
+	int tiles = pixel_tiles(pool, &args);
+
+	if (tiles > 0)
+		pool_for_finish(pool, tiles, hist_tile, merge_hist, &args);
+	memcpy(hist, reduction_result(args.hist), sizeof(uint64_t) * HIST_BINS);
+
+	reduction_destroy(args.hist);
+}
+
+int thresfilter_pool(filter_pool *pool, const int xsize, const int ysize, pixel *src, enum thres_policy policy, double param)
+{
+	uint64_t hist[HIST_BINS];
+	thresfilter_histogram(pool, xsize, ysize, src, hist);
+	return thresfilter_apply(pool, xsize, ysize, src, hist, policy, param);
+}
+
+int thresfilter_apply(filter_pool *pool, const int xsize, const int ysize, pixel *src, const uint64_t *hist, enum thres_policy policy, double param)
+{
+	thread_args args;
+	args.src = src;
+	args.gray = NULL;
+	args.N = xsize * ysize;
 
-	pthread_barrier_destroy(&barrier);
-	pthread_mutex_destroy(&sum_lock);
+	int tiles = pixel_tiles(pool, &args);
+
+	int t = hist_threshold(hist, policy, param);
+	thres_lut(t, args.lut);
+	if (tiles > 0)
+		pool_for(pool, tiles, set_tile, &args);
+	return t;
+}
+
+int thresfilter_gray(filter_pool *pool, const int xsize, const int ysize, unsigned char *src, enum thres_policy policy, double param)
+{
+	thread_args args;
+	args.src = NULL;
+	args.gray = src;
+	args.N = xsize * ysize;
+	args.hist = reduction_create(pool_size(pool), HIST_BINS);
+
+	int tiles = pixel_tiles(pool, &args);
+
+	if (tiles > 0)
+		pool_for_finish(pool, tiles, hist_tile, merge_hist, &args);
+	int t = hist_threshold(reduction_result(args.hist), policy, param);
+	reduction_destroy(args.hist);
+
+	thres_lut(t, args.lut);
+	if (tiles > 0)
+		pool_for(pool, tiles, set_tile, &args);
+	return t;
+}
+
+// Histogram of args->src or args->gray, threshold, then pack_tile
+static int pack_pbm(filter_pool *pool, thread_args *args, const int xsize, const int ysize, enum thres_policy policy, double param)
+{
+	args->N = xsize * ysize;
+	args->hist = reduction_create(pool_size(pool), HIST_BINS);
+
+	int tiles = pixel_tiles(pool, args);
+
+	if (tiles > 0)
+		pool_for_finish(pool, tiles, hist_tile, merge_hist, args);
+	args->t = hist_threshold(reduction_result(args->hist), policy, param);
+	reduction_destroy(args->hist);
+	if (tiles == 0)
+		return args->t;
+
+	args->xsize = xsize;
+	args->ysize = ysize;
+	args->band = (ysize + TILES_PER_WORKER * pool_size(pool) - 1) / (TILES_PER_WORKER * pool_size(pool));
+	pool_for(pool, (ysize + args->band - 1) / args->band, pack_tile, args);
+	return args->t;
+}
+
+int thresfilter_pbm(filter_pool *pool, const int xsize, const int ysize, pixel *src, enum thres_policy policy, double param, unsigned char *bits)
+{
+	thread_args args;
+	args.src = src;
+	args.gray = NULL;
+	args.bits = bits;
+	return pack_pbm(pool, &args, xsize, ysize, policy, param);
+}
+
+int thresfilter_gray_pbm(filter_pool *pool, const int xsize, const int ysize, unsigned char *src, enum thres_policy policy, double param, unsigned char *bits)
+{
+	thread_args args;
+	args.src = NULL;
+	args.gray = src;
+	args.bits = bits;
+	return pack_pbm(pool, &args, xsize, ysize, policy, param);
+}
+
+int thresfilter(const int xsize, const int ysize, pixel *src, int thread_count, enum thres_policy policy, double param)
+{
+	filter_pool *pool = pool_create(thread_count, 1);
+	int t = thresfilter_pool(pool, xsize, ysize, src, policy, param);
+	pool_destroy(pool);
+	return t;
 }
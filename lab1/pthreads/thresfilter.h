@@ -6,11 +6,34 @@
 #ifndef _THRESFILTER_H_
 #define _THRESFILTER_H_
 
-/* NOTE: This structure must not be padded! */
-typedef struct _pixel
-{
-  unsigned char r, g, b;
-} pixel;
+#include "pixel.h"
+#include "pool.h"
+#include "../histogram.h"
 
-void thresfilter(const int xsize, const int ysize, pixel *src, int thread_count);
+/* Thresholds src in place on the workers of pool. One pass builds the
+   r+g+b histogram, the threshold is chosen from it by policy and a lookup
+   table binarises the pixels. Returns the threshold. */
+int thresfilter_pool(filter_pool *pool, const int xsize, const int ysize, pixel *src, enum thres_policy policy, double param);
+
+/* First half of thresfilter_pool: the r+g+b histogram of src, HIST_BINS
+   counters written to hist. */
+void thresfilter_histogram(filter_pool *pool, const int xsize, const int ysize, pixel *src, uint64_t *hist);
+
+/* Second half of thresfilter_pool: chooses the threshold from an already
+   built histogram and binarises src. Returns the threshold. */
+int thresfilter_apply(filter_pool *pool, const int xsize, const int ysize, pixel *src, const uint64_t *hist, enum thres_policy policy, double param);
+
+/* Same as thresfilter_pool on a single-channel image of xsize * ysize
+   bytes. Gray g is counted and binarised as the pixel r = g = b, so the
+   threshold and result match those of the RGB expansion. */
+int thresfilter_gray(filter_pool *pool, const int xsize, const int ysize, unsigned char *src, enum thres_policy policy, double param);
+
+/* As thresfilter_pool and thresfilter_gray, but src is left alone and the
+   result goes to bits as ysize bit-packed PBM (P4) rows of
+   PBM_ROW_BYTES(xsize) bytes, a set bit for black. Returns the threshold. */
+int thresfilter_pbm(filter_pool *pool, const int xsize, const int ysize, pixel *src, enum thres_policy policy, double param, unsigned char *bits);
+int thresfilter_gray_pbm(filter_pool *pool, const int xsize, const int ysize, unsigned char *src, enum thres_policy policy, double param, unsigned char *bits);
+
+/* Same as thresfilter_pool on a pool that only lives for this call. */
+int thresfilter(const int xsize, const int ysize, pixel *src, int thread_count, enum thres_policy policy, double param);
 #endif
@@ -2,50 +2,189 @@
 #include <stdio.h>
 #include <string.h>
 #include <time.h>
+#include <unistd.h>
 #include "../ppmio.h"
 #include "thresfilter.h"
-#include <math.h>
+#include "numa.h"
+#include "../imgbuf.h"
+#include "../phases.h"
 
-int main(int argc, char **argv)
+// Writes the PBM rows of thresfilter_pbm and releases them
+static int write_bits(const char *outfile, const int xsize, const int ysize, unsigned char *bits)
+{
+	printf("Writing output file\n");
+	phase_begin(PHASE_WRITE);
+	int ret = write_pbm(outfile, xsize, ysize, (char *)bits);
+	phase_end();
+	imgbuf_put(bits);
+	return ret;
+}
+
+// Thresholds a mapped PGM file, or the luma of a mapped PPM file, into a PGM
+// file, or a PBM file with pbm set
+static int thres_gray(filter_pool *pool, enum thres_policy policy, double param, int pbm, ppm_map *img, const char *outfile)
 {
 	struct timespec stime, etime;
-	int xsize, ysize, N;
-	pixel *src = (pixel *)malloc(sizeof(pixel) * MAX_PIXELS);
+	size_t n = (size_t)img->xsize * img->ysize;
+	unsigned char *gray = (unsigned char *)img->data;
+	unsigned char *bits = pbm ? imgbuf_get(PBM_ROW_BYTES(img->xsize) * img->ysize) : NULL;
 
-	/* Take care of the arguments */
-	if (argc != 4)
+	if (img->channels == 3)
 	{
-		fprintf(stderr, "Usage: %s threads infile outfile\n", argv[0]);
-		exit(1);
+		phase_begin(PHASE_READ);
+		gray = imgbuf_get(n);
+		rgb_to_luma(img->data, (char *)gray, n);
+		phase_end();
 	}
 
-	int threads = atoi(argv[1]);
-	int exponent = log2f(threads);
-	if ((threads > 64 || threads < 1 || exponent != ceil(exponent)))
+	clock_gettime(CLOCK_REALTIME, &stime);
+	int t = bits != NULL ? thresfilter_gray_pbm(pool, img->xsize, img->ysize, gray, policy, param, bits)
+						 : thresfilter_gray(pool, img->xsize, img->ysize, gray, policy, param);
+	clock_gettime(CLOCK_REALTIME, &etime);
+	printf("Filtering took: %g secs\n", (etime.tv_sec - stime.tv_sec) + 1e-9 * (etime.tv_nsec - stime.tv_nsec));
+	printf("Threshold: %d\n", t);
+
+	// Write result
+	int ret;
+	if (bits != NULL)
+		ret = write_bits(outfile, img->xsize, img->ysize, bits);
+	else
 	{
-		fprintf(stderr, "Threads (%d) must be an element of the 2^n series and <= 64", threads);
-		exit(1);
+		printf("Writing output file\n");
+		phase_begin(PHASE_WRITE);
+		ret = write_pnm(outfile, img->xsize, img->ysize, 1, (char *)gray);
+		phase_end();
 	}
+	if (gray != (unsigned char *)img->data)
+		imgbuf_put(gray);
+	return ret;
+}
 
-	int colmax;
-	/* Read file */
-	if (read_ppm(argv[2], &xsize, &ysize, &colmax, (char *)src) != 0)
-		exit(1);
-	N = xsize * ysize;
+// Thresholds one image file into another on the workers of pool
+static int thres_image(filter_pool *pool, enum thres_policy policy, double param, int numa, int luma, int pbm, const char *infile, const char *outfile)
+{
+	struct timespec stime, etime;
+	int xsize, ysize, colmax;
+	ppm_map img;
+	pixel *src;
+
+	/* Map file */
+	phase_begin(PHASE_READ);
+	int mapped = map_ppm(infile, &img);
+	phase_end();
+	if (mapped != 0)
+		return 1;
+	xsize = img.xsize;
+	ysize = img.ysize;
+	colmax = img.max;
+	src = (pixel *)img.data;
 
 	if (colmax > 255)
 	{
 		fprintf(stderr, "Too large maximum color-component value\n");
-		exit(1);
+		unmap_ppm(&img);
+		return 1;
+	}
+
+	if (img.channels == 1 || luma)
+	{
+		int ret = 1;
+		if (numa)
+			fprintf(stderr, "%s: gray images are not placed with -N\n", infile);
+		else
+			ret = thres_gray(pool, policy, param, pbm, &img, outfile);
+		unmap_ppm(&img);
+		return ret;
+	}
+
+	// Work on a copy spread over the nodes of the workers
+	if (numa)
+	{
+		src = numa_place(pool, xsize, ysize, src);
+		if (src == NULL)
+		{
+			unmap_ppm(&img);
+			return 1;
+		}
+		numa_report(pool, xsize, ysize, src);
 	}
 
+	unsigned char *bits = pbm ? imgbuf_get(PBM_ROW_BYTES(xsize) * ysize) : NULL;
+
 	clock_gettime(CLOCK_REALTIME, &stime);
-	thresfilter(xsize, ysize, src, threads);
+	int t = bits != NULL ? thresfilter_pbm(pool, xsize, ysize, src, policy, param, bits)
+						 : thresfilter_pool(pool, xsize, ysize, src, policy, param);
 	clock_gettime(CLOCK_REALTIME, &etime);
 	printf("Filtering took: %g secs\n", (etime.tv_sec - stime.tv_sec) + 1e-9 * (etime.tv_nsec - stime.tv_nsec));
+	printf("Threshold: %d\n", t);
 
 	// Write result
-	printf("Writing output file\n");
-	if (write_ppm(argv[3], xsize, ysize, (char *)src) != 0)
+	int ret;
+	if (bits != NULL)
+		ret = write_bits(outfile, xsize, ysize, bits);
+	else
+	{
+		printf("Writing output file\n");
+		phase_begin(PHASE_WRITE);
+		ret = write_ppm(outfile, xsize, ysize, (char *)src);
+		phase_end();
+	}
+	if (numa)
+		numa_free(src, xsize, ysize);
+	unmap_ppm(&img);
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	enum thres_policy policy = THRES_MEAN;
+	double param = 0;
+	int numa = 0, luma = 0, pbm = 0;
+
+	phases_init(argv[0], 0);
+
+	/* Take care of the arguments */
+	int opt;
+	while ((opt = getopt(argc, argv, "p:Ngb")) != -1)
+	{
+		if (opt == 'N')
+			numa = 1;
+		else if (opt == 'g')
+			luma = 1;
+		else if (opt == 'b')
+			pbm = 1;
+		else if (opt != 'p' || parse_thres_policy(optarg, &policy, &param) != 0)
+		{
+			fprintf(stderr, "Policy must be mean, otsu or percentile:P with 0 <= P <= 100\n");
+			argc = 0;
+		}
+	}
+	// Drop the options, keeping the program name in argv[0]
+	argv[optind - 1] = argv[0];
+	argc -= optind - 1;
+	argv += optind - 1;
+
+	if (argc < 4 || argc % 2 != 0)
+	{
+		fprintf(stderr, "Usage: %s [-p mean|otsu|percentile:P] [-N] [-g] [-b] threads infile outfile [infile outfile ...]\n", argv[0]);
+		fprintf(stderr, "  -g: threshold the luma of PPM input into PGM output, PGM (P5) input is always thresholded as gray\n");
+		fprintf(stderr, "  -b: write a bit-packed PBM (P4) mask instead\n");
+		exit(1);
+	}
+
+	int threads = atoi(argv[1]);
+	if (threads < 1)
+	{
+		fprintf(stderr, "Threads (%d) must be greater than zero\n", threads);
 		exit(1);
+	}
+
+	/* One set of workers for all the images */
+	filter_pool *pool = pool_create(threads, 1);
+
+	for (int f = 2; f < argc; f += 2)
+		if (thres_image(pool, policy, param, numa, luma, pbm, argv[f], argv[f + 1]) != 0)
+			exit(1);
+
+	pool_destroy(pool);
 }
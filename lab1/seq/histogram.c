@@ -0,0 +1,119 @@
+/*
+  File: histogram.c
+
+  Implementation of the histogram based threshold engine. One pass over the
+  image builds a histogram of r+g+b, the threshold is picked from the
+  histogram and a lookup table binarises the pixels.
+
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "histogram.h"
+
+int parse_thres_policy(const char *str, enum thres_policy *policy, double *param) {
+  char *end;
+
+  *param = 0;
+  if (strcmp(str, "mean") == 0)
+    *policy = THRES_MEAN;
+  else if (strcmp(str, "otsu") == 0)
+    *policy = THRES_OTSU;
+  else if (strncmp(str, "percentile:", 11) == 0) {
+    *policy = THRES_PERCENTILE;
+    *param = strtod(str + 11, &end);
+    if (*end != '\0' || *param < 0 || *param > 100)
+      return 1;
+  } else
+    return 1;
+  return 0;
+}
+
+void hist_add(uint64_t *hist, const unsigned char *rgb, long count) {
+  long i;
+
+  for (i = 0; i < count; i++, rgb += 3)
+    hist[rgb[0] + rgb[1] + rgb[2]]++;
+}
+
+void hist_merge(uint64_t *hist, const uint64_t *other) {
+  int i;
+
+  for (i = 0; i < HIST_BINS; i++)
+    hist[i] += other[i];
+}
+
+/* Integer mean, so the result matches summing all pixels and dividing */
+static int mean_threshold(const uint64_t *hist, uint64_t n) {
+  uint64_t sum = 0;
+  int i;
+
+  for (i = 0; i < HIST_BINS; i++)
+    sum += hist[i] * i;
+  return sum / n;
+}
+
+static int otsu_threshold(const uint64_t *hist, uint64_t n) {
+  double total = 0, sum0 = 0, best = -1;
+  uint64_t n0 = 0;
+  int i, t = 0;
+
+  for (i = 0; i < HIST_BINS; i++)
+    total += (double)hist[i] * i;
+
+  /* Class 0 is [0, i), class 1 is [i, HIST_BINS) */
+  for (i = 1; i < HIST_BINS; i++) {
+    n0 += hist[i - 1];
+    sum0 += (double)hist[i - 1] * (i - 1);
+    if (n0 == 0 || n0 == n)
+      continue;
+    double mu0 = sum0 / n0, mu1 = (total - sum0) / (n - n0);
+    double between = (double)n0 * (n - n0) * (mu0 - mu1) * (mu0 - mu1);
+    if (between > best) {
+      best = between;
+      t = i;
+    }
+  }
+  return t;
+}
+
+static int percentile_threshold(const uint64_t *hist, uint64_t n, double percent) {
+  double below = 0, target = n * percent / 100;
+  int t;
+
+  for (t = 0; t < HIST_BINS && below < target; t++)
+    below += hist[t];
+  return t;
+}
+
+int hist_threshold(const uint64_t *hist, enum thres_policy policy, double param) {
+  uint64_t n = 0;
+  int i;
+
+  for (i = 0; i < HIST_BINS; i++)
+    n += hist[i];
+  if (n == 0)
+    return 0;
+
+  switch (policy) {
+  case THRES_OTSU:
+    return otsu_threshold(hist, n);
+  case THRES_PERCENTILE:
+    return percentile_threshold(hist, n, param);
+  default:
+    return mean_threshold(hist, n);
+  }
+}
+
+void thres_lut(int t, unsigned char *lut) {
+  int i;
+
+  for (i = 0; i < HIST_BINS; i++)
+    lut[i] = i < t ? 0 : 255;
+}
+
+void thres_apply(unsigned char *rgb, long count, const unsigned char *lut) {
+  long i;
+
+  for (i = 0; i < count; i++, rgb += 3)
+    rgb[0] = rgb[1] = rgb[2] = lut[rgb[0] + rgb[1] + rgb[2]];
+}
@@ -0,0 +1,42 @@
+/*
+  File: histogram.h
+
+  Declarations for the histogram based threshold engine.
+
+ */
+
+#ifndef _HISTOGRAM_H_
+#define _HISTOGRAM_H_
+
+#include <stdint.h>
+
+/* r+g+b of a pixel ranges over 0..765 */
+#define HIST_BINS 766
+
+/* How the threshold is chosen from the histogram */
+enum thres_policy {
+  THRES_MEAN,        /* mean intensity, as the original filter */
+  THRES_OTSU,        /* maximal between-class variance */
+  THRES_PERCENTILE   /* param percent of the pixels fall below */
+};
+
+/* Parse "mean", "otsu" or "percentile:P" into policy and param. */
+/* Returns: 0 on success.                                      */
+int parse_thres_policy(const char *str, enum thres_policy *policy, double *param);
+
+/* Add count pixels of packed r,g,b bytes to hist[HIST_BINS]. */
+void hist_add(uint64_t *hist, const unsigned char *rgb, long count);
+
+/* hist[i] += other[i] for all bins. */
+void hist_merge(uint64_t *hist, const uint64_t *other);
+
+/* Choose the threshold t from hist: pixels with r+g+b >= t become white. */
+int hist_threshold(const uint64_t *hist, enum thres_policy policy, double param);
+
+/* Fill lut[HIST_BINS] with 0 below t and 255 from t on. */
+void thres_lut(int t, unsigned char *lut);
+
+/* Binarise count pixels of packed r,g,b bytes through lut. */
+void thres_apply(unsigned char *rgb, long count, const unsigned char *lut);
+
+#endif
@@ -1,28 +1,19 @@
+#include <string.h>
 #include "thresfilter.h"
-#define uint unsigned int 
 
-void thresfilter(const int xsize, const int ysize, pixel* src)
+int thresfilter(const int xsize, const int ysize, pixel* src, enum thres_policy policy, double param)
 {
-	uint sum, i, psum, nump;
-	nump = xsize * ysize;
+	uint64_t hist[HIST_BINS];
+	unsigned char lut[HIST_BINS];
+	long nump = (long)xsize * ysize;
+	int t;
 	
-	for (i = 0, sum = 0; i < nump; i++)
-	{
-		sum += (uint)src[i].r + (uint)src[i].g + (uint)src[i].b;
-	}
+	memset(hist, 0, sizeof(hist));
+	hist_add(hist, &src->r, nump);
 	
-	sum /= nump;
+	t = hist_threshold(hist, policy, param);
+	thres_lut(t, lut);
 	
-	for (i = 0; i < nump; i++)
-	{
-		psum = (uint)src[i].r + (uint)src[i].g + (uint)src[i].b;
-		if (sum > psum)
-		{
-			src[i].r = src[i].g = src[i].b = 0;
-		}
-		else
-		{
-			src[i].r = src[i].g = src[i].b = 255;
-		}
-	}
+	thres_apply(&src->r, nump, lut);
+	return t;
 }
@@ -6,11 +6,15 @@
 #ifndef _THRESFILTER_H_
 #define _THRESFILTER_H_
 
+#include "histogram.h"
+
 /* NOTE: This structure must not be padded! */
 typedef struct _pixel {
 	unsigned char r,g,b;
 } pixel;
 
-void thresfilter(const int xsize, const int ysize, pixel* src);
+/* Thresholds src in place with the threshold policy picks from the r+g+b
+   histogram. Returns the threshold. */
+int thresfilter(const int xsize, const int ysize, pixel* src, enum thres_policy policy, double param);
 
 #endif
@@ -2,6 +2,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <time.h>
+#include <unistd.h>
 #include "ppmio.h"
 #include "thresfilter.h"
 
@@ -10,11 +11,23 @@ int main (int argc, char ** argv)
 	int xsize, ysize, colmax;
 	pixel *src = (pixel*) malloc(sizeof(pixel) * MAX_PIXELS);
 	struct timespec stime, etime;
+	enum thres_policy policy = THRES_MEAN;
+	double param = 0;
+	int opt, t;
 	
 	/* Take care of the arguments */
+	while ((opt = getopt(argc, argv, "p:")) != -1)
+	{
+		if (opt != 'p' || parse_thres_policy(optarg, &policy, &param) != 0)
+			argc = 0;
+	}
+	argv[optind - 1] = argv[0];
+	argc -= optind - 1;
+	argv += optind - 1;
+	
 	if (argc != 3)
 	{
-		fprintf(stderr, "Usage: %s infile outfile\n", argv[0]);
+		fprintf(stderr, "Usage: %s [-p mean|otsu|percentile:P] infile outfile\n", argv[0]);
 		exit(1);
 	}
 	
@@ -31,10 +44,11 @@ int main (int argc, char ** argv)
 	printf("Has read the image, calling filter\n");
 
 	clock_gettime(CLOCK_REALTIME, &stime);
-	thresfilter(xsize, ysize, src);
+	t = thresfilter(xsize, ysize, src, policy, param);
 	clock_gettime(CLOCK_REALTIME, &etime);
 	
 	printf("Filtering took: %g secs\n", (etime.tv_sec  - stime.tv_sec) + 1e-9*(etime.tv_nsec  - stime.tv_nsec)) ;
+	printf("Threshold: %d\n", t);
 	
 	/* Write result */
 	printf("Writing output file\n");
@@ -1,36 +1,39 @@
+import csv
+import json
+import sys
+from collections import defaultdict
+
 import matplotlib.pyplot as plt
 
-x = [1, 2, 4, 8, 16, 32, 64]
-blur_pthreads = [16.3786, 8.55247, 4.32111, 2.21067, 1.26054, 0.982082, 1.17529]
-threshold_mpi = [0.088511, 0.062794, 0.031244, 0.020858, 0.016567, 0.013478, 0.008912]
-threshold_pthreads = [0.109217, 0.0535817, 0.0371549, 0.0252247, 0.0157444, 0.0183072, 0.0130858]
-blur_mpi = [14.018321, 7.058290, 3.750033, 1.937216, 1.107606, 0.754410, 0.656233]
-lapl_omp = [0.181218, 0.104422, 0.064208, 0.043191, 0.034682, 0.051359]
+# Results written by bench.py, CSV or JSON
+if len(sys.argv) != 2:
+    print('Usage: %s results.csv|results.json' % sys.argv[0], file=sys.stderr)
+    sys.exit(1)
 
-# create subplots
-fig, (ax1, ax2, ax3) = plt.subplots(1, 3, figsize=(12, 4))
+with open(sys.argv[1]) as f:
+    rows = json.load(f) if sys.argv[1].endswith('.json') else list(csv.DictReader(f))
 
-# plot for blur
-ax1.plot(x, blur_pthreads, 'ro-', label='Pthreads')
-ax1.plot(x, blur_mpi, 'go-', label='MPI')
-ax1.set_title('Blur Execution Time')
-ax1.set_xlabel('Threads/Processes')
-ax1.set_ylabel('Execution Time (s)')
-ax1.legend()
+# One line per implementation and parameter, median time over workers
+series = defaultdict(lambda: defaultdict(list))
+for row in rows:
+    label = row['impl']
+    if str(row['param']) != '':
+        label += ' (%s)' % row['param']
+    if row['input']:
+        label += ' ' + row['input']
+    series[row['benchmark']][label].append((int(row['workers']), float(row['median']), float(row['stddev'])))
 
-# plot for threshold
-ax2.plot(x, threshold_pthreads, 'ro-', label='Pthreads')
-ax2.plot(x, threshold_mpi, 'go-', label='MPI')
-ax2.set_title('Threshold Execution Time')
-ax2.set_xlabel('Threads/Processes')
-ax2.set_ylabel('Execution Time (s)')
-ax2.legend()
+# create subplots
+fig, axes = plt.subplots(1, len(series), figsize=(4 * len(series), 4), squeeze=False)
 
-# plot for lapl_omp
-ax3.plot(x[:-1], lapl_omp, 'bo-', label='OpenMP')
-ax3.set_title('Laplacian Execution Time')
-ax3.set_xlabel('Threads')
-ax3.set_ylabel('Execution Time (s)')
-ax3.legend()
+for ax, (bench, lines) in zip(axes[0], sorted(series.items())):
+    for label, points in sorted(lines.items()):
+        points.sort()
+        x = [p[0] for p in points]
+        ax.errorbar(x, [p[1] for p in points], yerr=[p[2] for p in points], marker='o', capsize=3, label=label)
+    ax.set_title('%s Execution Time' % bench.capitalize())
+    ax.set_xlabel('Threads/Processes')
+    ax.set_ylabel('Execution Time (s)')
+    ax.legend()
 
 plt.show()